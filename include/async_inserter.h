@@ -0,0 +1,204 @@
+#ifndef ASYNCINSERTER_H
+#define ASYNCINSERTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+/**
+ * Write-combining front end of an id_bimap.
+ *
+ * Producers enqueue values into a lock-free MPSC queue and receive a future of the key,
+ * while one writer thread drains the queue in batches, drops the duplicates of a batch
+ * and inserts the rest with a single lock acquisition of the bimap.
+ *
+ * @note The bimap must outlive the inserter, and insert() must not be called after the
+ * destruction has begun. The destructor applies every value enqueued before it.
+ */
+template <typename bimapType>
+class async_inserter
+{
+    public:
+        using bimap_type = bimapType;
+        using mapped_type = typename bimap_type::mapped_type;
+        using key_type = typename bimap_type::key_type;
+
+        explicit async_inserter(bimap_type& p_bimap, std::size_t p_maxBatchSize = 1024)
+            : m_bimap(p_bimap)
+            , m_maxBatchSize(p_maxBatchSize ? p_maxBatchSize : 1)
+            , m_head(new Node)
+            , m_tail(m_head.load())
+        {
+            m_writer = std::thread(&async_inserter::run, this);
+        }
+
+        async_inserter(const async_inserter&) = delete;
+        async_inserter& operator=(const async_inserter&) = delete;
+
+        ~async_inserter()
+        {
+            {
+                std::lock_guard lock(m_waitMutex);
+                m_stop = true;
+            }
+            m_wakeup.notify_one();
+            m_writer.join();
+
+            delete m_tail;
+        }
+
+        std::future<key_type> insert(mapped_type p_value)
+        {
+            auto* node = new Node;
+            node->m_value.emplace(std::move(p_value));
+            auto future = node->m_promise.get_future();
+
+            push(node);
+            if (m_waiting)
+            {
+                std::lock_guard lock(m_waitMutex);
+                m_wakeup.notify_one();
+            }
+
+            return future;
+        }
+
+    private:
+        struct Node
+        {
+            std::atomic<Node*> m_next = nullptr;
+            std::optional<mapped_type> m_value;
+            std::promise<key_type> m_promise;
+        };
+
+        void push(Node* p_node)
+        {
+            Node* prev = m_head.exchange(p_node);
+            prev->m_next.store(p_node, std::memory_order_release);
+        }
+
+        /**
+         * @note Must only be called from the writer thread!
+         */
+        bool isEmpty() const
+        { return m_head.load() == m_tail; }
+
+        /**
+         * Moves the value and the promise of the next node into the batch.
+         *
+         * @note Must only be called from the writer thread!
+         *
+         * @return false if the queue is empty.
+         */
+        bool pop(std::vector<mapped_type>& p_values, std::vector<std::promise<key_type>>& p_promises)
+        {
+            Node* next = m_tail->m_next.load(std::memory_order_acquire);
+            while (!next)
+            {
+                if (isEmpty())
+                    return false;
+
+                // A producer has swapped the head but has not linked its node yet.
+                std::this_thread::yield();
+                next = m_tail->m_next.load(std::memory_order_acquire);
+            }
+
+            p_values.push_back(std::move(*next->m_value));
+            p_promises.push_back(std::move(next->m_promise));
+            next->m_value.reset();
+
+            delete m_tail;
+            m_tail = next;
+            return true;
+        }
+
+        void waitForWork()
+        {
+            std::unique_lock lock(m_waitMutex);
+            m_waiting = true;
+            m_wakeup.wait(lock, [this]{ return m_stop || !isEmpty(); });
+            m_waiting = false;
+        }
+
+        void run()
+        {
+            std::vector<mapped_type> values;
+            std::vector<std::promise<key_type>> promises;
+
+            while (true)
+            {
+                while (values.size() < m_maxBatchSize && pop(values, promises))
+                {}
+
+                if (values.empty())
+                {
+                    if (m_stop && isEmpty())
+                        return;
+
+                    waitForWork();
+                    continue;
+                }
+
+                apply(values, promises);
+                values.clear();
+                promises.clear();
+            }
+        }
+
+        void apply(std::vector<mapped_type>& p_values, std::vector<std::promise<key_type>>& p_promises)
+        {
+            // The first occurrence of each value is inserted, the others share its key.
+            std::map<std::reference_wrapper<const mapped_type>, std::size_t, std::less<mapped_type>> positions;
+            std::vector<std::size_t> requestPositions;
+            std::vector<std::size_t> uniqueIndices;
+            for (auto i = 0u; i < p_values.size(); ++i)
+            {
+                const auto [it, inserted] = positions.emplace(p_values[i], uniqueIndices.size());
+                if (inserted)
+                    uniqueIndices.push_back(i);
+                requestPositions.push_back(it->second);
+            }
+
+            std::vector<mapped_type> uniqueValues;
+            uniqueValues.reserve(uniqueIndices.size());
+            for (const auto index : uniqueIndices)
+                uniqueValues.push_back(std::move(p_values[index]));
+
+            std::vector<key_type> keys;
+            try
+            {
+                keys = m_bimap.insert_batch(uniqueValues.cbegin(), uniqueValues.cend());
+            }
+            catch (...)
+            {
+                for (auto& promise : p_promises)
+                    promise.set_exception(std::current_exception());
+                return;
+            }
+
+            for (auto i = 0u; i < p_promises.size(); ++i)
+                p_promises[i].set_value(keys[requestPositions[i]]);
+        }
+
+        bimap_type& m_bimap;
+        const std::size_t m_maxBatchSize;
+
+        std::atomic<Node*> m_head;
+        Node* m_tail;
+
+        std::mutex m_waitMutex;
+        std::condition_variable m_wakeup;
+        std::atomic<bool> m_waiting = false;
+        std::atomic<bool> m_stop = false;
+
+        std::thread m_writer;
+};
+
+#endif
@@ -3,10 +3,15 @@
 
 #include <cassert>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
 #include <functional> 
+#include <limits>
 #include <map>
 #include <string>
 #include <type_traits>
+#include <utility>
 #include <stdexcept>
 #include <set>
 #include <vector>
@@ -14,10 +19,14 @@
 #include <memory>
 #include <mutex>
 #include <shared_mutex>
+#include <thread>
 
 struct NoValueType
 {};
 
+template <typename mappedType, typename keyType>
+class frozen_id_bimap;
+
 template <typename mappedType = NoValueType, typename keyType = std::size_t>
 class id_bimap
 {
@@ -26,9 +35,55 @@ class id_bimap
     public:
         using mapped_type = mappedType;
         using key_type = keyType;
-        using TMappedMap = std::map<const std::reference_wrapper<const mapped_type>, key_type, MappedLess>;
+        using THash = std::uint32_t;
+        using THashVector = std::vector<THash>;
+
+        /**
+         * Key of the reverse index: the fingerprint of the value is compared first, so
+         * candidates with a different fingerprint are rejected without touching the value.
+         */
+        struct MappedKey
+        {
+            THash m_hash;
+            std::reference_wrapper<const mapped_type> m_value;
+        };
+
+        using TMappedMap = std::map<MappedKey, key_type, MappedLess>;
         using TVector = std::vector<std::optional<mapped_type>>;
         using TMutex = std::shared_mutex;
+        // Maps the keys of a merged map to the merged keys, empty for its deleted ids.
+        using TRemap = std::vector<std::optional<key_type>>;
+        // Maps the ids handed out by a block to the keys their values got instead.
+        using TBlockRemap = std::map<key_type, key_type>;
+        using version_type = std::uint64_t;
+        using TEvictionCallback = std::function<void(key_type, const mapped_type&)>;
+
+        enum class ChangeType
+        {
+            Insert,
+            Erase,
+            Clear
+        };
+
+        /**
+         * One modification recorded in the change log. Only inserts carry a value.
+         */
+        struct Change
+        {
+            ChangeType m_type;
+            key_type m_key;
+            std::optional<mapped_type> m_value;
+        };
+
+        /**
+         * The changes turning a map of version @p m_from into version @p m_to.
+         */
+        struct Delta
+        {
+            version_type m_from;
+            version_type m_to;
+            std::vector<Change> m_changes;
+        };
 
         struct Iterator
         {
@@ -37,21 +92,24 @@ class id_bimap
             using reference_type    = const std::pair<const key_type&, const mapped_type&>&;
             using pointer_type      = const std::pair<const key_type&, const mapped_type&>*;
 
-            Iterator(const TVector& p_vector, const TMappedMap& p_mapped, key_type p_index)
+            Iterator(const TVector& p_vector, const THashVector& p_hashes, const TMappedMap& p_mapped, key_type p_index)
                 : m_vector(p_vector)
+                , m_hashes(p_hashes)
                 , m_mapped(p_mapped)
             {
                 m_iterator = p_vector.cbegin();
                 std::advance(m_iterator, p_index);
-                m_current = std::make_shared<value_type>(m_mapped.at(m_iterator->value()), m_iterator->value());
+                updateCurrent();
             }
 
             Iterator(
                 const TVector& p_vector,
+                const THashVector& p_hashes,
                 const TMappedMap& p_mapped,
                 const typename TVector::const_iterator& p_iterator)
                 : m_iterator(p_iterator)
                 , m_vector(p_vector)
+                , m_hashes(p_hashes)
                 , m_mapped(p_mapped)
             {}
 
@@ -71,8 +129,7 @@ class id_bimap
                 {
                     if (m_iterator->has_value())
                     {
-                        m_current =
-                            std::make_shared<value_type>(m_mapped.at(m_iterator->value()), m_iterator->value());
+                        updateCurrent();
                         return *this;
                     }
                 }
@@ -86,12 +143,279 @@ class id_bimap
             { return a.m_iterator != b.m_iterator; };
 
         private:
+            void updateCurrent()
+            {
+                const auto& hash = m_hashes[std::distance(m_vector.cbegin(), m_iterator)];
+                m_current = std::make_shared<value_type>(
+                    m_mapped.at(MappedKey{hash, m_iterator->value()}), m_iterator->value());
+            }
+
             typename TVector::const_iterator m_iterator;
             const TVector& m_vector;
+            const THashVector& m_hashes;
             const TMappedMap& m_mapped;
             std::shared_ptr<value_type> m_current;
         };
 
+        /**
+         * Block of ids reserved by reserve_block(), which lets a thread insert without
+         * the exclusive lock. An insert looks the value up under the shared lock, and a
+         * new value gets the next id of the block straight away. The new values are staged
+         * in the block and published together with one exclusive acquisition, when the
+         * block runs out of ids, on flush() and on release. Until then, the other threads
+         * do not see them.
+         *
+         * If another thread has inserted the same value first, or a clear() has
+         * invalidated the ids, the published value keeps its other key, and flush() and
+         * release() report the change of key.
+         *
+         * @note A block is meant to be owned by one thread, and it must be released before
+         * the map is moved or destroyed. Inserting, flushing and releasing take the lock
+         * of the map, so they must not be called by a thread holding a session of the map.
+         */
+        class Block
+        {
+            public:
+                Block(Block&& p_other) noexcept
+                    : m_owner(std::exchange(p_other.m_owner, nullptr))
+                    , m_size(p_other.m_size)
+                    , m_keys(std::move(p_other.m_keys))
+                    , m_staged(std::move(p_other.m_staged))
+                    , m_stagedIndex(std::move(p_other.m_stagedIndex))
+                    , m_remap(std::move(p_other.m_remap))
+                    , m_remappedKeys(std::move(p_other.m_remappedKeys))
+                {}
+
+                Block(const Block&) = delete;
+                Block& operator=(const Block&) = delete;
+
+                Block& operator=(Block&& p_other) noexcept
+                {
+                    if (this != &p_other)
+                    {
+                        release();
+                        m_owner = std::exchange(p_other.m_owner, nullptr);
+                        m_size = p_other.m_size;
+                        m_keys = std::move(p_other.m_keys);
+                        m_staged = std::move(p_other.m_staged);
+                        m_stagedIndex = std::move(p_other.m_stagedIndex);
+                        m_remap = std::move(p_other.m_remap);
+                        m_remappedKeys = std::move(p_other.m_remappedKeys);
+                    }
+                    return *this;
+                }
+
+                ~Block()
+                { release(); }
+
+                /**
+                 * @return The key of the value and whether it was inserted. The key of a
+                 * new value is final once flush() or release() does not remap it.
+                 */
+                std::pair<key_type, bool> insert(const mapped_type& p_value)
+                {
+                    if (!m_owner)
+                        throw std::logic_error("released block");
+
+                    return m_owner->blockInsert(*this, p_value);
+                }
+
+                /**
+                 * Publishes the staged values.
+                 *
+                 * @return The ids handed out since the last flush whose values got another
+                 * key.
+                 */
+                TBlockRemap flush()
+                {
+                    if (!m_owner)
+                        throw std::logic_error("released block");
+
+                    m_owner->flushBlock(*this);
+                    return std::exchange(m_remap, {});
+                }
+
+                std::size_t remaining() const
+                { return m_keys.size(); }
+
+                /**
+                 * Publishes the staged values and returns the unused ids to the map.
+                 *
+                 * @return The same as flush().
+                 */
+                TBlockRemap release()
+                {
+                    if (m_owner)
+                        m_owner->releaseBlock(*this);
+                    m_owner = nullptr;
+                    m_keys.clear();
+                    return std::exchange(m_remap, {});
+                }
+
+            private:
+                friend class id_bimap;
+
+                /**
+                 * A value inserted through the block but not published yet.
+                 */
+                struct Staged
+                {
+                    key_type m_key;
+                    THash m_hash;
+                    mapped_type m_value;
+                };
+
+                Block(id_bimap& p_owner, std::size_t p_size)
+                    : m_owner(&p_owner)
+                    , m_size(p_size)
+                {}
+
+                id_bimap* m_owner;
+                std::size_t m_size;
+                // The reserved ids in descending order, so the smallest is used first.
+                std::vector<key_type> m_keys;
+                // A deque, so that the index can refer to the staged values.
+                std::deque<Staged> m_staged;
+                TMappedMap m_stagedIndex;
+                TBlockRemap m_remap;
+                // The reserved ids in m_remap, only freed once m_remap is reported, so
+                // that no id is handed out twice in between.
+                std::vector<key_type> m_remappedKeys;
+        };
+
+        /**
+         * Holds the lock of the map for its lifetime and exposes the read API without
+         * locking, so a series of lookups pays for one lock acquisition. Iterators obtained
+         * from a session stay valid while the session lives.
+         *
+         * Sessions do not cover merge(), apply(), freeze(), reserve_block(),
+         * reorder_by_frequency() and the setters, which take the locks themselves.
+         *
+         * @note The lock is not recursive: a thread holding a session must not call the
+         * locking API of the map, a block of the map included, or open another session.
+         */
+        template <typename lockType>
+        class BasicSession
+        {
+            public:
+                std::size_t size() const
+                { return m_map.m_valuesMap.size(); }
+
+                bool empty() const
+                { return m_map.m_valuesMap.empty(); }
+
+                const key_type& operator[](const mapped_type& p_value) const
+                { return m_map.keyImpl(p_value); }
+
+                const mapped_type& operator[](const key_type& p_key) const
+                { return m_map.valueImpl(p_key); }
+
+                Iterator find(const mapped_type& p_value) const
+                { return m_map.findImpl(p_value, fingerprint(p_value)); }
+
+                Iterator find_if(std::function<bool(const mappedType&)> p_function) const
+                { return m_map.findIfImpl(p_function); }
+
+                Iterator begin() const
+                { return m_map.beginImpl(); }
+
+                Iterator end() const
+                { return m_map.endImpl(); }
+
+                key_type next_index() const
+                { return m_map.nextIndexImpl(); }
+
+                std::size_t capacity() const
+                { return m_map.capacityImpl(); }
+
+                bool is_contiguous() const
+                { return m_map.isContiguousImpl(); }
+
+                version_type version() const
+                { return m_map.m_version; }
+
+                std::optional<Delta> changes_since(version_type p_version) const
+                { return m_map.changesSinceImpl(p_version); }
+
+                std::size_t max_size() const
+                { return m_map.m_maxSize; }
+
+                std::uint32_t access_count(key_type p_key) const
+                { return m_map.accessCountImpl(p_key); }
+
+            protected:
+                BasicSession(const id_bimap& p_map)
+                    : m_map(p_map)
+                    , m_lock(p_map.m_mutex)
+                {}
+
+                const id_bimap& m_map;
+                lockType m_lock;
+        };
+
+        /**
+         * Session holding the shared lock.
+         */
+        class ReadSession : public BasicSession<std::shared_lock<TMutex>>
+        {
+            private:
+                friend class id_bimap;
+
+                ReadSession(const id_bimap& p_map)
+                    : BasicSession<std::shared_lock<TMutex>>(p_map)
+                {}
+        };
+
+        /**
+         * Session holding the exclusive lock, which adds the modifying API.
+         *
+         * @note Like for a std::vector, an insertion may invalidate the iterators.
+         */
+        class WriteSession : public BasicSession<std::unique_lock<TMutex>>
+        {
+            public:
+                std::pair<Iterator, bool> insert(const mappedType& p_value)
+                {
+                    const auto [index, inserted] = m_mutableMap.insertImpl(p_value);
+                    m_mutableMap.evictOverflow(index);
+                    return {Iterator(m_mutableMap.m_vector, m_mutableMap.m_hashes, m_mutableMap.m_valuesMap, index),
+                        inserted};
+                }
+
+                template <typename InputIt>
+                std::vector<key_type> insert_batch(InputIt p_first, InputIt p_last)
+                { return m_mutableMap.insertBatchImpl(p_first, p_last); }
+
+                template<class... Args>
+                std::pair<Iterator, bool> emplace(Args&&... args)
+                { return m_mutableMap.emplaceImpl(std::forward<Args>(args)...); }
+
+                void erase(key_type p_key)
+                { m_mutableMap.eraseImpl(p_key); }
+
+                void erase(const mapped_type& p_value)
+                { m_mutableMap.eraseImpl(p_value); }
+
+                void delete_all(std::function<bool(const mappedType&)> p_function)
+                { m_mutableMap.deleteAllImpl(p_function); }
+
+                void clear()
+                { m_mutableMap.clearImpl(); }
+
+                void reserve(std::size_t p_size)
+                { m_mutableMap.reserveImpl(p_size); }
+
+            private:
+                friend class id_bimap;
+
+                WriteSession(id_bimap& p_map)
+                    : BasicSession<std::unique_lock<TMutex>>(p_map)
+                    , m_mutableMap(p_map)
+                {}
+
+                id_bimap& m_mutableMap;
+        };
+
         id_bimap()
         {
             static_assert(!std::is_same<mapped_type, NoValueType>::value,
@@ -114,9 +438,19 @@ class id_bimap
 
         id_bimap(id_bimap&& p_other) noexcept
             : m_vector(std::move(p_other.m_vector))
+            , m_hashes(std::move(p_other.m_hashes))
             , m_valuesMap(std::move(p_other.m_valuesMap))
             , m_logicalDeletedKeys(std::move(p_other.m_logicalDeletedKeys))
+            , m_reservedKeys(std::move(p_other.m_reservedKeys))
             , m_reserveSize(p_other.m_reserveSize)
+            , m_version(p_other.m_version)
+            , m_changeLog(std::move(p_other.m_changeLog))
+            , m_changeLogCapacity(p_other.m_changeLogCapacity)
+            , m_slotStats(std::move(p_other.m_slotStats))
+            , m_trackFrequency(p_other.m_trackFrequency)
+            , m_maxSize(p_other.m_maxSize)
+            , m_clockHand(p_other.m_clockHand)
+            , m_evictionCallback(std::move(p_other.m_evictionCallback))
         {}
 
         ~id_bimap() = default;
@@ -137,9 +471,19 @@ class id_bimap
                 std::lock(lhs_lk, rhs_lk);
 
                 m_vector = std::move(p_other.m_vector);
+                m_hashes = std::move(p_other.m_hashes);
                 m_valuesMap = std::move(p_other.m_valuesMap);
                 m_logicalDeletedKeys = std::move(p_other.m_logicalDeletedKeys);
+                m_reservedKeys = std::move(p_other.m_reservedKeys);
                 m_reserveSize = p_other.m_reserveSize;
+                m_version = p_other.m_version;
+                m_changeLog = std::move(p_other.m_changeLog);
+                m_changeLogCapacity = p_other.m_changeLogCapacity;
+                m_slotStats = std::move(p_other.m_slotStats);
+                m_trackFrequency = p_other.m_trackFrequency;
+                m_maxSize = p_other.m_maxSize;
+                m_clockHand = p_other.m_clockHand;
+                m_evictionCallback = std::move(p_other.m_evictionCallback);
             }
             return *this;
         }
@@ -159,124 +503,66 @@ class id_bimap
         void clear()
         {
             std::unique_lock lock(m_mutex);
-
-            m_valuesMap.clear();
-            m_vector.clear();
-            m_logicalDeletedKeys.clear();
-            m_reserveSize = 0;
+            clearImpl();
         }
 
         std::pair<Iterator, bool> insert(const mappedType& p_value)
         {
             std::unique_lock lock(m_mutex);
 
-            const auto it = findImpl(p_value);
-
-            if (it != endImpl())
-                return {it, false};
-
-            const auto index = pop_next_index();
-            if (index < m_vector.size())
-            {
-                const auto inputIndex = index;
-                m_vector[index].emplace(p_value);
-                m_valuesMap[*m_vector[index]] = index;
-            }
-            else
-            {
-                const auto prevCapacity = m_vector.capacity();
-                m_vector.push_back(p_value);
-
-                if (prevCapacity == m_vector.capacity())
-                {
-                    if (m_reserveSize)
-                        --m_reserveSize;
-
-                    m_valuesMap[*m_vector[index]] = index;
-                }
-                else
-                {
-                    m_reserveSize = 0;
-                    UpdateValueMap();
-                }
-            }
+            const auto [index, inserted] = insertImpl(p_value);
+            evictOverflow(index);
+            return {Iterator(m_vector, m_hashes, m_valuesMap, index), inserted};
+        }
 
-            return {Iterator(m_vector, m_valuesMap, index), true};
+        /**
+         * Inserts every value of the range under a single lock acquisition. A bounded map
+         * evicts after the whole range is inserted, so no key is reused within the batch,
+         * but some of the returned keys may already be evicted.
+         *
+         * @return The keys of the values in the order of the range.
+         */
+        template <typename InputIt>
+        std::vector<key_type> insert_batch(InputIt p_first, InputIt p_last)
+        {
+            std::unique_lock lock(m_mutex);
+            return insertBatchImpl(p_first, p_last);
         }
 
         const key_type& operator[](const mapped_type& p_value) const
         {
             std::shared_lock lock(m_mutex);
-
-            try
-            {
-                return m_valuesMap.at(p_value);
-            }
-            catch(const std::out_of_range& p_exception)
-            {
-                throw std::domain_error("domain error");
-            }
+            return keyImpl(p_value);
         }
 
         const mapped_type& operator[](const key_type& p_key) const
         {
             std::shared_lock lock(m_mutex);
-
-            if (p_key < m_vector.size())
-            {
-                if (m_vector[p_key].has_value())
-                    return *m_vector[p_key];
-            }
-            throw std::out_of_range("out of range");
+            return valueImpl(p_key);
         }
 
         void erase(key_type p_key)
         {
             std::unique_lock lock(m_mutex);
-
-            if (p_key < m_vector.size())
-            {
-                if (m_vector[p_key].has_value())
-                {
-                    m_valuesMap.erase(*m_vector[p_key]);
-                    m_logicalDeletedKeys.insert(p_key);
-                    m_vector[p_key].reset();
-                }
-            }
+            eraseImpl(p_key);
         }
 
         void erase(const mapped_type& p_value)
         {
             std::unique_lock lock(m_mutex);
-
-            const auto it = m_valuesMap.find(p_value);
-
-            if (it == m_valuesMap.end())
-                return;
-
-            const auto key = it->second;
-            m_valuesMap.erase(it);
-            m_logicalDeletedKeys.insert(key);
-            m_vector[key].reset();
+            eraseImpl(p_value);
         }
 
         Iterator find(const mapped_type& p_value) const
         {
             std::shared_lock lock(m_mutex);
-            return findImpl(p_value);
+            return findImpl(p_value, fingerprint(p_value));
         }
 
         Iterator begin() const
         {
             std::shared_lock lock(m_mutex);
-
-            for (auto i = 0u; i < m_vector.size(); ++i)
-            {
-                if (m_vector[i].has_value())
-                    return Iterator(m_vector, m_valuesMap, i);
-            }
-
-            return endImpl();
+            return beginImpl();
         }
 
         Iterator end() const
@@ -289,214 +575,1482 @@ class id_bimap
         std::pair<Iterator, bool> emplace(Args&&... args)
         {
             std::unique_lock lock(m_mutex);
-
-            const auto index = pop_next_index();
-            if (index < m_vector.size())
-            {
-                m_vector[index].emplace(std::forward<Args>(args)...);
-                m_valuesMap[*m_vector[index]] = index;
-            }
-            else
-            {
-                const auto prevCapacity = m_vector.capacity();
-
-                m_vector.emplace_back(std::forward<Args>(args)...);
-
-                if (prevCapacity == m_vector.capacity())
-                {
-                    if (m_reserveSize)
-                        --m_reserveSize;
-
-                    m_valuesMap[*m_vector[index]] = index;
-                }
-                else
-                {
-                    m_reserveSize = 0;
-                    UpdateValueMap();
-                }
-            }
-
-            return {Iterator(m_vector, m_valuesMap, index), true};
+            return emplaceImpl(std::forward<Args>(args)...);
         }
 
         Iterator find_if(std::function<bool(const mappedType&)> p_function) const
         {
             std::shared_lock lock(m_mutex);
-
-            for (auto i = 0u; i != m_vector.size(); ++i)
-            {
-                if (m_vector[i].has_value() && p_function(*m_vector[i]))
-                    return Iterator(m_vector, m_valuesMap, i);
-            }
-
-            return endImpl();
+            return findIfImpl(p_function);
         }
 
         void delete_all(std::function<bool(const mappedType&)> p_function)
         {
             std::unique_lock lock(m_mutex);
+            deleteAllImpl(p_function);
+        }
 
-            for (auto i = 0u; i != m_vector.size(); ++i)
-            {
-                if (m_vector[i].has_value() && p_function(*m_vector[i]))
-                {
-                    m_logicalDeletedKeys.insert(i);
-                    m_valuesMap.erase(*m_vector[i]);
-                    m_vector[i].reset();
-                }
-            }
+        /**
+         * Bounds the number of values. When an insertion exceeds the bound, a value not
+         * looked up since the last pass of the eviction is erased, and its key becomes
+         * a deleted id. Zero removes the bound.
+         */
+        void set_max_size(std::size_t p_maxSize)
+        {
+            std::unique_lock lock(m_mutex);
+
+            m_maxSize = p_maxSize;
+            evictOverflow(m_vector.size());
         }
 
-        key_type next_index() const
+        std::size_t max_size() const
         {
             std::shared_lock lock(m_mutex);
-            return m_logicalDeletedKeys.empty() ? m_vector.size() : *m_logicalDeletedKeys.begin();
+            return m_maxSize;
         }
 
-        std::size_t capacity() const
+        /**
+         * @p p_callback is called with each evicted entry before it is erased.
+         *
+         * @note The callback runs under the exclusive lock and must not access the map.
+         */
+        void set_eviction_callback(TEvictionCallback p_callback)
         {
-            std::shared_lock lock(m_mutex);
-            return m_vector.size() + m_reserveSize;
+            std::unique_lock lock(m_mutex);
+            m_evictionCallback = std::move(p_callback);
         }
 
-        bool is_contiguous() const
+        /**
+         * Enables counting the lookups of each value for reorder_by_frequency(). The
+         * counts are kept when it is disabled.
+         */
+        void track_access_frequency(bool p_enable)
         {
-            std::shared_lock lock(m_mutex);
-            bool hasValue = false;
-            for (auto it = m_vector.rbegin(); it != m_vector.rend(); ++it)
-            {
-                if (it->has_value())
-                    hasValue = true;
-                else if (hasValue)
-                    return false;
-            }
+            std::unique_lock lock(m_mutex);
+            m_trackFrequency = p_enable;
+        }
 
-            return true;
+        /**
+         * @return The number of lookups of @p p_key since it was inserted.
+         */
+        std::uint32_t access_count(key_type p_key) const
+        {
+            std::shared_lock lock(m_mutex);
+            return accessCountImpl(p_key);
         }
 
-        void reserve(std::size_t p_size)
+        /**
+         * Reassigns the keys so that the most looked up values get the smallest ones,
+         * ties keeping their previous order. The map becomes contiguous, and replicas
+         * following its change log have to be copied again.
+         *
+         * @return The old keys remapped to the new keys.
+         */
+        TRemap reorder_by_frequency()
         {
             std::unique_lock lock(m_mutex);
 
-            if (p_size > m_vector.size())
+            std::vector<key_type> order;
+            order.reserve(m_valuesMap.size());
+            for (auto i = 0u; i < m_vector.size(); ++i)
             {
-                m_reserveSize = p_size - m_vector.size();
-                const auto prevCapacity = m_vector.capacity();
-                m_vector.reserve(p_size);
-                if (prevCapacity < p_size)
-                    UpdateValueMap();
+                if (m_vector[i].has_value())
+                    order.push_back(i);
             }
-            else if (p_size  < m_vector.size())
+            std::stable_sort(order.begin(), order.end(), [this](key_type p_lhs, key_type p_rhs)
             {
-                if (m_logicalDeletedKeys.empty())
-                    return;
-
-
-                auto count = 0u;
-                for (auto it = m_vector.rbegin(); it != m_vector.rend(); ++it)
-                {
-                    if (it->has_value())
-                        break;
-                    ++count;
-                }
+                return m_slotStats[p_lhs].m_accessCount.load(std::memory_order_relaxed) >
+                    m_slotStats[p_rhs].m_accessCount.load(std::memory_order_relaxed);
+            });
+
+            TRemap remap(m_vector.size());
+            TVector vector(order.size());
+            THashVector hashes(order.size());
+            std::deque<SlotStats> slotStats(order.size());
+            for (auto i = 0u; i < order.size(); ++i)
+            {
+                const auto oldKey = order[i];
+                remap[oldKey] = i;
+                vector[i].emplace(std::move(*m_vector[oldKey]));
+                hashes[i] = m_hashes[oldKey];
+                slotStats[i].assign(m_slotStats[oldKey]);
+            }
 
-                const auto numberOfDeletion = m_vector.size() - p_size;
+            m_vector.swap(vector);
+            m_hashes.swap(hashes);
+            m_slotStats.swap(slotStats);
+            UpdateValueMap(remap);
 
-                if (numberOfDeletion > count)
-                    return;
+            m_logicalDeletedKeys.clear();
+            m_reservedKeys.clear();
+            m_reserveSize = 0;
+            m_clockHand = 0;
 
-                for (auto i = 0; i < numberOfDeletion; ++i)
-                    m_logicalDeletedKeys.erase(prev(m_logicalDeletedKeys.end()));
+            // Every key has changed, so the recorded changes are useless for the replicas.
+            m_changeLog.clear();
+            ++m_version;
 
-                m_reserveSize = 0;
-                const auto prevCapacity = m_vector.capacity();
-                m_vector.reserve(p_size);
-                if (prevCapacity < p_size)
-                    UpdateValueMap();
-            }
-            else
-            {
-                m_reserveSize = 0;
-            }
+            return remap;
+        }
+
+        /**
+         * @return The number of modifications since the construction of the map. Copies
+         * and moves keep the version of their source.
+         */
+        version_type version() const
+        {
+            std::shared_lock lock(m_mutex);
+            return m_version;
+        }
+
+        /**
+         * Records the last @p p_capacity modifications for changes_since(). Zero disables
+         * the change log.
+         */
+        void set_change_log_capacity(std::size_t p_capacity)
+        {
+            static_assert(std::is_copy_constructible<mapped_type>::value,
+                "The change log requires a copyable value.");
+
+            std::unique_lock lock(m_mutex);
+
+            m_changeLogCapacity = p_capacity;
+            while (m_changeLog.size() > m_changeLogCapacity)
+                m_changeLog.pop_front();
+        }
+
+        /**
+         * @return The changes after @p p_version, or nothing if they are no longer in the
+         * change log and the replica has to be copied again.
+         */
+        std::optional<Delta> changes_since(version_type p_version) const
+        {
+            std::shared_lock lock(m_mutex);
+            return changesSinceImpl(p_version);
+        }
+
+        /**
+         * Applies the changes of a master map. The map must be at the version the delta
+         * starts from, e.g. a copy of the master.
+         */
+        void apply(const Delta& p_delta)
+        {
+            std::unique_lock lock(m_mutex);
+
+            if (p_delta.m_from != m_version)
+                throw std::invalid_argument("version mismatch");
+
+            for (const auto& change : p_delta.m_changes)
+            {
+                switch (change.m_type)
+                {
+                    case ChangeType::Insert:
+                        assignSlot(change.m_key, *change.m_value);
+                        break;
+                    case ChangeType::Erase:
+                        if (change.m_key < m_vector.size() && m_vector[change.m_key].has_value())
+                            unlinkSlot(change.m_key);
+                        break;
+                    case ChangeType::Clear:
+                        clearImpl();
+                        break;
+                }
+            }
+
+            m_version = p_delta.m_to;
+        }
+
+        /**
+         * Inserts the values of @p p_other that are missing from this map, taking each
+         * lock once. Large maps are looked up in parallel partitions.
+         *
+         * @return The keys of @p p_other remapped to the keys of this map.
+         */
+        TRemap merge(const id_bimap& p_other)
+        { return merge(std::vector<const id_bimap*>{&p_other}).front(); }
+
+        /**
+         * Merges every map of @p p_others in order. The locks are taken in address order,
+         * so concurrent merges in opposite directions cannot deadlock. Like insert_batch(),
+         * a bounded map evicts once every map is merged.
+         *
+         * @return One remap table per element of @p p_others.
+         */
+        std::vector<TRemap> merge(const std::vector<const id_bimap*>& p_others)
+        {
+            std::vector<const id_bimap*> maps(p_others);
+            maps.push_back(this);
+            std::sort(maps.begin(), maps.end(), std::less<const id_bimap*>());
+            maps.erase(std::unique(maps.begin(), maps.end()), maps.end());
+
+            std::unique_lock lock(m_mutex, std::defer_lock);
+            std::vector<std::shared_lock<TMutex>> otherLocks;
+            otherLocks.reserve(maps.size());
+            for (const auto* map : maps)
+            {
+                if (map == this)
+                    lock.lock();
+                else
+                    otherLocks.emplace_back(map->m_mutex);
+            }
+
+            std::vector<TRemap> remaps;
+            remaps.reserve(p_others.size());
+            for (const auto* other : p_others)
+                remaps.push_back(mergeImpl(*other));
+
+            evictOverflow(m_vector.size());
+            return remaps;
+        }
+
+        /**
+         * @return A guard holding the shared lock until it is destroyed.
+         */
+        ReadSession read_session() const
+        { return ReadSession(*this); }
+
+        /**
+         * @return A guard holding the exclusive lock until it is destroyed.
+         */
+        WriteSession write_session()
+        { return WriteSession(*this); }
+
+        /**
+         * Reserves @p p_size ids for the returned block, first from the deleted ids and
+         * then from the end of the map. Until their values are published, the reserved
+         * ids are holes that no other insertion takes, and copies of the map get them as
+         * deleted ids.
+         */
+        Block reserve_block(std::size_t p_size)
+        {
+            Block block(*this, p_size ? p_size : 1);
+
+            std::unique_lock lock(m_mutex);
+            fillBlock(block);
+            return block;
+        }
+
+        key_type next_index() const
+        {
+            std::shared_lock lock(m_mutex);
+            return nextIndexImpl();
+        }
+
+        std::size_t capacity() const
+        {
+            std::shared_lock lock(m_mutex);
+            return capacityImpl();
+        }
+
+        /**
+         * @return An immutable copy of the map with a minimal perfect hash for the
+         * value -> key direction. The keys are preserved.
+         */
+        frozen_id_bimap<mapped_type, key_type> freeze() const &
+        {
+            std::shared_lock lock(m_mutex);
+
+            std::vector<key_type> keys;
+            std::vector<mapped_type> values;
+            keys.reserve(m_valuesMap.size());
+            values.reserve(m_valuesMap.size());
+            for (auto i = 0u; i < m_vector.size(); ++i)
+            {
+                if (m_vector[i].has_value())
+                {
+                    keys.push_back(i);
+                    values.push_back(*m_vector[i]);
+                }
+            }
+
+            return frozen_id_bimap<mapped_type, key_type>(std::move(keys), std::move(values));
+        }
+
+        /**
+         * Moves the values into the returned frozen map and leaves this map empty.
+         */
+        frozen_id_bimap<mapped_type, key_type> freeze() &&
+        {
+            std::unique_lock lock(m_mutex);
+
+            std::vector<key_type> keys;
+            std::vector<mapped_type> values;
+            keys.reserve(m_valuesMap.size());
+            values.reserve(m_valuesMap.size());
+            m_valuesMap.clear();
+            for (auto i = 0u; i < m_vector.size(); ++i)
+            {
+                if (m_vector[i].has_value())
+                {
+                    keys.push_back(i);
+                    values.push_back(std::move(*m_vector[i]));
+                }
+            }
+
+            clearImpl();
+
+            return frozen_id_bimap<mapped_type, key_type>(std::move(keys), std::move(values));
+        }
+
+        bool is_contiguous() const
+        {
+            std::shared_lock lock(m_mutex);
+            return isContiguousImpl();
+        }
+
+        void reserve(std::size_t p_size)
+        {
+            std::unique_lock lock(m_mutex);
+            reserveImpl(p_size);
         }
 
     private:
+        template <typename, typename>
+        friend class frozen_id_bimap;
+
+        /**
+         * Access statistics of a slot, updated by the lookups under the shared lock.
+         */
+        struct SlotStats
+        {
+            // Second-chance flag of a bounded map.
+            std::atomic<bool> m_referenced = false;
+            std::atomic<std::uint32_t> m_accessCount = 0;
+
+            void assign(const SlotStats& p_other)
+            {
+                m_referenced.store(p_other.m_referenced.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                m_accessCount.store(p_other.m_accessCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+
+            void reset()
+            {
+                m_referenced.store(false, std::memory_order_relaxed);
+                m_accessCount.store(0, std::memory_order_relaxed);
+            }
+        };
+
         struct MappedLess
         {
-            bool operator()(const mapped_type& p_lhs, const mapped_type& p_rhs) const 
-            { return p_lhs < p_rhs; }
-        };
+            bool operator()(const MappedKey& p_lhs, const MappedKey& p_rhs) const 
+            {
+                if (p_lhs.m_hash != p_rhs.m_hash)
+                    return p_lhs.m_hash < p_rhs.m_hash;
+                return p_lhs.m_value.get() < p_rhs.m_value.get();
+            }
+        };
+
+        id_bimap(const id_bimap& p_other, std::unique_lock<TMutex> p_otherLock)
+            : m_vector(p_other.m_vector)
+            , m_hashes(p_other.m_hashes)
+            , m_logicalDeletedKeys(p_other.m_logicalDeletedKeys)
+            , m_reserveSize(p_other.m_reserveSize)
+            , m_version(p_other.m_version)
+            , m_changeLog(p_other.m_changeLog)
+            , m_changeLogCapacity(p_other.m_changeLogCapacity)
+            , m_slotStats(p_other.m_slotStats.size())
+            , m_trackFrequency(p_other.m_trackFrequency)
+            , m_maxSize(p_other.m_maxSize)
+            , m_clockHand(p_other.m_clockHand)
+            , m_evictionCallback(p_other.m_evictionCallback)
+        {
+            // The order of the other index is valid for the copied values too.
+            for (const auto& [mappedKey, key] : p_other.m_valuesMap)
+                m_valuesMap.emplace_hint(m_valuesMap.end(), MappedKey{mappedKey.m_hash, *m_vector[key]}, key);
+
+            for (auto i = 0u; i < m_slotStats.size(); ++i)
+                m_slotStats[i].assign(p_other.m_slotStats[i]);
+
+            // The blocks stay with the other map, so their ids are free in the copy.
+            m_logicalDeletedKeys.insert(p_other.m_reservedKeys.cbegin(), p_other.m_reservedKeys.cend());
+        }
+
+        /**
+         * Builds a map from ascending @p p_keys and their values. The ids missing from
+         * @p p_keys become deleted ids.
+         */
+        static id_bimap fromSlots(const std::vector<key_type>& p_keys, std::vector<mapped_type>&& p_values)
+        {
+            id_bimap result;
+            if (p_keys.empty())
+                return result;
+
+            const std::size_t size = p_keys.back() + 1;
+            result.m_vector.resize(size);
+            result.m_hashes.resize(size);
+            result.m_slotStats.resize(size);
+            for (auto i = 0u; i < p_keys.size(); ++i)
+            {
+                result.m_vector[p_keys[i]].emplace(std::move(p_values[i]));
+                result.linkSlot(p_keys[i], fingerprint(*result.m_vector[p_keys[i]]));
+            }
+
+            for (auto i = 0u; i < size; ++i)
+            {
+                if (!result.m_vector[i].has_value())
+                    result.m_logicalDeletedKeys.emplace_hint(result.m_logicalDeletedKeys.end(), i);
+            }
+
+            return result;
+        }
+
+        /**
+         * Values without a std::hash specialization share one fingerprint, and the
+         * reverse index falls back to comparing the values themselves.
+         */
+        static THash fingerprint(const mapped_type& p_value)
+        {
+            if constexpr (std::is_invocable_v<std::hash<mapped_type>, const mapped_type&>)
+            {
+                const std::size_t hash = std::hash<mapped_type>{}(p_value);
+                return static_cast<THash>(hash ^ (hash >> (sizeof(std::size_t) * 4)));
+            }
+            else
+            {
+                return 0;
+            }
+        }
+
+        static constexpr std::size_t s_parallelMergeThreshold = 1 << 15;
+
+        /**
+         * @note You must lock the @p m_mutex and the mutex of @p p_other before calling
+         * this function!
+         */
+        TRemap mergeImpl(const id_bimap& p_other)
+        {
+            const auto& otherVector = p_other.m_vector;
+            TRemap remap(otherVector.size());
+
+            // The values already in this map are looked up with the cached fingerprints,
+            // concurrently for large maps, as the index is only read here.
+            const auto lookup = [this, &p_other, &remap](std::size_t p_first, std::size_t p_last)
+            {
+                for (auto i = p_first; i < p_last; ++i)
+                {
+                    if (!p_other.m_vector[i].has_value())
+                        continue;
+
+                    const auto it = m_valuesMap.find(MappedKey{p_other.m_hashes[i], *p_other.m_vector[i]});
+                    if (it != m_valuesMap.end())
+                        remap[i] = it->second;
+                }
+            };
+
+            const std::size_t threadCount = std::min<std::size_t>(
+                std::max(1u, std::thread::hardware_concurrency()),
+                otherVector.size() / s_parallelMergeThreshold);
+            if (threadCount > 1)
+            {
+                const auto partitionSize = (otherVector.size() + threadCount - 1) / threadCount;
+                std::vector<std::thread> threads;
+                for (auto i = 1u; i < threadCount; ++i)
+                    threads.emplace_back(lookup, i * partitionSize, std::min(otherVector.size(), (i + 1) * partitionSize));
+                lookup(0, partitionSize);
+                for (auto& thread : threads)
+                    thread.join();
+            }
+            else
+            {
+                lookup(0, otherVector.size());
+            }
+
+            if (&p_other == this)
+                return remap;
+
+            std::size_t missing = 0;
+            for (auto i = 0u; i < otherVector.size(); ++i)
+            {
+                if (otherVector[i].has_value() && !remap[i])
+                    ++missing;
+            }
+
+            // Grow once, so the index is relinked at most once.
+            const auto appended = missing - std::min(missing, m_logicalDeletedKeys.size());
+            if (m_vector.size() + appended > m_vector.capacity())
+            {
+                m_vector.reserve(m_vector.size() + appended);
+                m_hashes.reserve(m_vector.size() + appended);
+                UpdateValueMap();
+            }
+
+            for (auto i = 0u; i < otherVector.size(); ++i)
+            {
+                if (otherVector[i].has_value() && !remap[i])
+                {
+                    const auto index = pop_next_index();
+                    constructSlot(index, *otherVector[i]);
+                    linkSlot(index, p_other.m_hashes[i]);
+                    remap[i] = index;
+                }
+            }
+
+            return remap;
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void reserveImpl(std::size_t p_size)
+        {
+            if (p_size > m_vector.size())
+            {
+                m_reserveSize = p_size - m_vector.size();
+                const auto prevCapacity = m_vector.capacity();
+                m_vector.reserve(p_size);
+                if (prevCapacity < p_size)
+                    UpdateValueMap();
+            }
+            else if (p_size  < m_vector.size())
+            {
+                if (m_logicalDeletedKeys.empty())
+                    return;
+
+
+                // The ids reserved by a block are kept, as the block may still use them.
+                auto count = 0u;
+                for (auto i = m_vector.size(); i > 0; --i)
+                {
+                    if (m_vector[i - 1].has_value() || m_reservedKeys.count(i - 1))
+                        break;
+                    ++count;
+                }
+
+                const auto numberOfDeletion = m_vector.size() - p_size;
+
+                if (numberOfDeletion > count)
+                    return;
+
+                for (auto i = 0; i < numberOfDeletion; ++i)
+                    m_logicalDeletedKeys.erase(prev(m_logicalDeletedKeys.end()));
+
+                m_vector.resize(p_size);
+                m_hashes.resize(p_size);
+                m_slotStats.resize(p_size);
+                m_reserveSize = 0;
+                const auto prevCapacity = m_vector.capacity();
+                m_vector.reserve(p_size);
+                if (prevCapacity < p_size)
+                    UpdateValueMap();
+            }
+            else
+            {
+                m_reserveSize = 0;
+            }
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void fillBlock(Block& p_block)
+        {
+            std::vector<key_type> keys;
+            keys.reserve(p_block.m_size);
+            while (keys.size() < p_block.m_size && !m_logicalDeletedKeys.empty())
+                keys.push_back(pop_next_index());
+
+            const auto missing = p_block.m_size - keys.size();
+            if (missing)
+            {
+                for (auto i = 0u; i < missing; ++i)
+                    keys.push_back(m_vector.size() + i);
+                appendEmptySlots(missing);
+            }
+
+            m_reservedKeys.insert(keys.cbegin(), keys.cend());
+            p_block.m_keys.assign(keys.rbegin(), keys.rend());
+        }
+
+        std::pair<key_type, bool> blockInsert(Block& p_block, const mapped_type& p_value)
+        {
+            const auto hash = fingerprint(p_value);
+
+            const auto staged = p_block.m_stagedIndex.find(MappedKey{hash, p_value});
+            if (staged != p_block.m_stagedIndex.end())
+                return {staged->second, false};
+
+            {
+                std::shared_lock lock(m_mutex);
+
+                const auto it = m_valuesMap.find(MappedKey{hash, p_value});
+                if (it != m_valuesMap.end())
+                {
+                    touch(it->second);
+                    return {it->second, false};
+                }
+            }
+
+            if (p_block.m_keys.empty())
+            {
+                std::unique_lock lock(m_mutex);
+                publishBlock(p_block);
+                fillBlock(p_block);
+            }
+
+            const auto index = p_block.m_keys.back();
+            p_block.m_keys.pop_back();
+
+            auto& value = p_block.m_staged.emplace_back(typename Block::Staged{index, hash, p_value});
+            p_block.m_stagedIndex.emplace(MappedKey{hash, value.m_value}, index);
+            return {index, true};
+        }
+
+        void flushBlock(Block& p_block)
+        {
+            std::unique_lock lock(m_mutex);
+
+            publishBlock(p_block);
+            unreserve(p_block.m_remappedKeys);
+            p_block.m_remappedKeys.clear();
+        }
+
+        void releaseBlock(Block& p_block)
+        {
+            std::unique_lock lock(m_mutex);
+
+            publishBlock(p_block);
+            unreserve(p_block.m_remappedKeys);
+            unreserve(p_block.m_keys);
+            p_block.m_remappedKeys.clear();
+        }
+
+        /**
+         * Turns the ids still reserved among @p p_keys into deleted ids.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void unreserve(const std::vector<key_type>& p_keys)
+        {
+            for (const auto index : p_keys)
+            {
+                if (m_reservedKeys.erase(index))
+                    m_logicalDeletedKeys.insert(index);
+            }
+        }
+
+        /**
+         * Inserts the staged values of the block at their ids. A value inserted by another
+         * thread keeps its key, and a value whose id was invalidated gets a new key, both
+         * recorded in the remap of the block. Like a batch, the eviction runs at the end.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void publishBlock(Block& p_block)
+        {
+            p_block.m_stagedIndex.clear();
+            for (auto& staged : p_block.m_staged)
+            {
+                const MappedKey mappedKey{staged.m_hash, staged.m_value};
+                const auto it = m_valuesMap.lower_bound(mappedKey);
+                if (it != m_valuesMap.end() && !m_valuesMap.key_comp()(mappedKey, it->first))
+                {
+                    p_block.m_remappedKeys.push_back(staged.m_key);
+                    p_block.m_remap[staged.m_key] = it->second;
+                    continue;
+                }
+
+                // The slot exists, so the index is not relinked and the position stays valid.
+                if (m_reservedKeys.erase(staged.m_key))
+                {
+                    m_vector[staged.m_key].emplace(std::move(staged.m_value));
+                    linkSlot(staged.m_key, staged.m_hash, it);
+                    continue;
+                }
+
+                // The id was invalidated, e.g. by a clear().
+                const auto index = pop_next_index();
+                constructSlot(index, std::move(staged.m_value));
+                linkSlot(index, staged.m_hash);
+                if (index != staged.m_key)
+                    p_block.m_remap[staged.m_key] = index;
+            }
+            p_block.m_staged.clear();
+
+            evictOverflow(m_vector.size());
+        }
+
+        /**
+         * Appends empty slots that are neither used nor deleted.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void appendEmptySlots(std::size_t p_count)
+        {
+            const auto prevCapacity = m_vector.capacity();
+            m_vector.resize(m_vector.size() + p_count);
+            m_hashes.resize(m_vector.size());
+            m_slotStats.resize(m_vector.size());
+
+            if (prevCapacity == m_vector.capacity())
+            {
+                m_reserveSize -= std::min<std::size_t>(m_reserveSize, p_count);
+            }
+            else
+            {
+                m_reserveSize = 0;
+                UpdateValueMap();
+            }
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         * 
+         * @return key_type 
+         */
+        key_type pop_next_index()
+        {
+            if (m_logicalDeletedKeys.empty())
+                return m_vector.size();
+
+            const auto ret = *m_logicalDeletedKeys.begin();
+            m_logicalDeletedKeys.erase(m_logicalDeletedKeys.begin());
+            return ret;
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        template <typename InputIt>
+        std::vector<key_type> insertBatchImpl(InputIt p_first, InputIt p_last)
+        {
+            std::vector<key_type> keys;
+            for (; p_first != p_last; ++p_first)
+                keys.push_back(insertImpl(*p_first).first);
+
+            evictOverflow(m_vector.size());
+            return keys;
+        }
+
+        /**
+         * Does not evict, so that a batch never reuses the keys it has returned. The
+         * caller has to call evictOverflow().
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        std::pair<key_type, bool> insertImpl(const mapped_type& p_value)
+        {
+            const auto hash = fingerprint(p_value);
+            const auto it = m_valuesMap.find(MappedKey{hash, p_value});
+
+            if (it != m_valuesMap.end())
+            {
+                touch(it->second);
+                return {it->second, false};
+            }
+
+            const auto index = pop_next_index();
+            constructSlot(index, p_value);
+            linkSlot(index, hash);
+
+            return {index, true};
+        }
+
+        /**
+         * Constructs the value in the slot of @p p_index, which is either a reused hole or
+         * the one past the last slot. The slot is not linked into the reverse index.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        template<class... Args>
+        void constructSlot(key_type p_index, Args&&... args)
+        {
+            if (p_index < m_vector.size())
+            {
+                m_vector[p_index].emplace(std::forward<Args>(args)...);
+                return;
+            }
+
+            const auto prevCapacity = m_vector.capacity();
+            m_vector.emplace_back(std::forward<Args>(args)...);
+            m_hashes.push_back(0);
+            m_slotStats.emplace_back();
+
+            if (prevCapacity == m_vector.capacity())
+            {
+                if (m_reserveSize)
+                    --m_reserveSize;
+            }
+            else
+            {
+                m_reserveSize = 0;
+                UpdateValueMap();
+            }
+        }
+
+        /**
+         * @p p_hint is where the value goes in the reverse index, if it is known.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void linkSlot(key_type p_index, THash p_hash, std::optional<typename TMappedMap::const_iterator> p_hint = {})
+        {
+            m_hashes[p_index] = p_hash;
+            m_slotStats[p_index].reset();
+            if (p_hint)
+                m_valuesMap.emplace_hint(*p_hint, MappedKey{p_hash, *m_vector[p_index]}, p_index);
+            else
+                m_valuesMap.emplace(MappedKey{p_hash, *m_vector[p_index]}, p_index);
+
+            if constexpr (std::is_copy_constructible<mapped_type>::value)
+                recordChange(ChangeType::Insert, p_index, *m_vector[p_index]);
+            else
+                recordChange(ChangeType::Insert, p_index);
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        std::uint32_t accessCountImpl(key_type p_key) const
+        {
+            if (p_key < m_vector.size() && m_vector[p_key].has_value())
+                return m_slotStats[p_key].m_accessCount.load(std::memory_order_relaxed);
+            throw std::out_of_range("out of range");
+        }
+
+        /**
+         * Marks the slot as recently used for the eviction and counts the access. Only
+         * atomics are written, so the shared lock is enough.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void touch(key_type p_index) const
+        {
+            auto& stats = m_slotStats[p_index];
+            // Readers of a hot value only load the flag, so they do not keep stealing its
+            // cache line from each other.
+            if (m_maxSize && !stats.m_referenced.load(std::memory_order_relaxed))
+                stats.m_referenced.store(true, std::memory_order_relaxed);
+
+            // The count saturates instead of wrapping around.
+            if (m_trackFrequency &&
+                stats.m_accessCount.load(std::memory_order_relaxed) != std::numeric_limits<std::uint32_t>::max())
+                stats.m_accessCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /**
+         * Evicts entries until the map fits its bound. Only the inserting operations call
+         * this, once they are done with the keys they hand out, so a replica applying a
+         * delta gets the evictions from the change log of its master instead of evicting
+         * on its own.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void evictOverflow(key_type p_protectedIndex)
+        {
+            while (m_maxSize && m_valuesMap.size() > m_maxSize)
+                evictOne(p_protectedIndex);
+        }
+
+        /**
+         * Second-chance (CLOCK) eviction: the hand clears the flag of the recently used
+         * slots and evicts the first slot whose flag is already clear.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void evictOne(key_type p_protectedIndex)
+        {
+            while (true)
+            {
+                if (m_clockHand >= m_vector.size())
+                    m_clockHand = 0;
+
+                const key_type index = m_clockHand++;
+                if (index == p_protectedIndex || !m_vector[index].has_value())
+                    continue;
+                if (m_slotStats[index].m_referenced.exchange(false, std::memory_order_relaxed))
+                    continue;
+
+                if (m_evictionCallback)
+                    m_evictionCallback(index, *m_vector[index]);
+                unlinkSlot(index);
+                return;
+            }
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void unlinkSlot(key_type p_index)
+        {
+            m_valuesMap.erase(MappedKey{m_hashes[p_index], *m_vector[p_index]});
+            m_logicalDeletedKeys.insert(p_index);
+            m_vector[p_index].reset();
+            recordChange(ChangeType::Erase, p_index);
+        }
+
+        /**
+         * Stores the value at @p p_key, the ids skipped before it become deleted ids.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void assignSlot(key_type p_key, const mapped_type& p_value)
+        {
+            if (p_key < m_vector.size())
+            {
+                if (m_vector[p_key].has_value())
+                    unlinkSlot(p_key);
+                m_logicalDeletedKeys.erase(p_key);
+                m_reservedKeys.erase(p_key);
+            }
+            else
+            {
+                const key_type first = m_vector.size();
+                appendEmptySlots(p_key - first + 1);
+                for (auto i = first; i < p_key; ++i)
+                    m_logicalDeletedKeys.insert(i);
+            }
+
+            m_vector[p_key].emplace(p_value);
+            linkSlot(p_key, fingerprint(*m_vector[p_key]));
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void clearImpl()
+        {
+            m_valuesMap.clear();
+            m_vector.clear();
+            m_hashes.clear();
+            m_slotStats.clear();
+            m_clockHand = 0;
+            m_logicalDeletedKeys.clear();
+            m_reservedKeys.clear();
+            m_reserveSize = 0;
+            recordChange(ChangeType::Clear, 0);
+        }
 
-        id_bimap(const id_bimap& p_other, std::unique_lock<TMutex> p_otherLock)
-            : m_vector(p_other.m_vector)
-            , m_logicalDeletedKeys(p_other.m_logicalDeletedKeys)
-            , m_reserveSize(p_other.m_reserveSize)
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        std::optional<Delta> changesSinceImpl(version_type p_version) const
         {
+            if (p_version > m_version || m_version - p_version > m_changeLog.size())
+                return std::nullopt;
 
-            for (auto i = 0u; i < m_vector.size(); ++i)
+            Delta delta{p_version, m_version, {}};
+            delta.m_changes.assign(m_changeLog.end() - (m_version - p_version), m_changeLog.end());
+            return delta;
+        }
+
+        /**
+         * Every modification increments the version by one, so the change log holds the
+         * changes of the last m_changeLog.size() versions.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        template<class... Args>
+        void recordChange(ChangeType p_type, key_type p_key, Args&&... p_value)
+        {
+            ++m_version;
+            if (!m_changeLogCapacity)
+                return;
+
+            if (m_changeLog.size() == m_changeLogCapacity)
+                m_changeLog.pop_front();
+            m_changeLog.push_back(Change{p_type, p_key, std::optional<mapped_type>(std::forward<Args>(p_value)...)});
+        }
+
+        /**
+         * Re-points the reverse index to the values after @p m_vector has been reallocated.
+         * Neither the order nor the fingerprints change, so the nodes are only relinked
+         * and no value is compared or hashed again. A non-empty @p p_remap gives the new
+         * key of each old key when the values have been moved to other slots.
+         *
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void UpdateValueMap(const TRemap& p_remap = {})
+        {
+            TMappedMap relinked;
+            while (!m_valuesMap.empty())
             {
-                if (m_vector[i])
-                    m_valuesMap[*m_vector[i]] = i;
+                auto node = m_valuesMap.extract(m_valuesMap.begin());
+                if (!p_remap.empty())
+                    node.mapped() = *p_remap[node.mapped()];
+                node.key().m_value = std::cref(*m_vector[node.mapped()]);
+                relinked.insert(relinked.end(), std::move(node));
             }
+            m_valuesMap.swap(relinked);
         }
 
         /**
          * @note You must lock the @p m_mutex before calling this function!
-         * 
-         * @return key_type 
          */
-        key_type pop_next_index()
+        const key_type& keyImpl(const mapped_type& p_value) const
         {
-            if (m_logicalDeletedKeys.empty())
-                return m_vector.size();
+            const auto it = m_valuesMap.find(MappedKey{fingerprint(p_value), p_value});
+            if (it == m_valuesMap.end())
+                throw std::domain_error("domain error");
 
-            const auto ret = *m_logicalDeletedKeys.begin();
-            m_logicalDeletedKeys.erase(m_logicalDeletedKeys.begin());
-            return ret;
+            touch(it->second);
+            return it->second;
         }
 
         /**
          * @note You must lock the @p m_mutex before calling this function!
          */
-        void UpdateValueMap()
+        const mapped_type& valueImpl(const key_type& p_key) const
         {
-            m_valuesMap.clear();
-            for (auto i = 0; i < m_vector.size(); ++i)
+            if (p_key < m_vector.size())
             {
-                if (m_vector[i].has_value())
-                    m_valuesMap[*m_vector[i]] = i;
+                if (m_vector[p_key].has_value())
+                {
+                    touch(p_key);
+                    return *m_vector[p_key];
+                }
+            }
+            throw std::out_of_range("out of range");
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void eraseImpl(key_type p_key)
+        {
+            if (p_key < m_vector.size())
+            {
+                if (m_vector[p_key].has_value())
+                    unlinkSlot(p_key);
             }
         }
 
         /**
          * @note You must lock the @p m_mutex before calling this function!
          */
-        Iterator endImpl() const
-        { return Iterator(m_vector, m_valuesMap, m_vector.end()); }
+        void eraseImpl(const mapped_type& p_value)
+        {
+            const auto it = m_valuesMap.find(MappedKey{fingerprint(p_value), p_value});
+
+            if (it == m_valuesMap.end())
+                return;
+
+            unlinkSlot(it->second);
+        }
 
         /**
          * @note You must lock the @p m_mutex before calling this function!
          */
-        Iterator findImpl(const mapped_type& p_value) const
+        template<class... Args>
+        std::pair<Iterator, bool> emplaceImpl(Args&&... args)
         {
-            try
+            const auto index = pop_next_index();
+            constructSlot(index, std::forward<Args>(args)...);
+
+            const auto hash = fingerprint(*m_vector[index]);
+            const auto it = findImpl(*m_vector[index], hash);
+            if (it != endImpl())
             {
-                const auto key = m_valuesMap.at(p_value);
-                return Iterator(m_vector, m_valuesMap, key);
+                m_vector[index].reset();
+                m_logicalDeletedKeys.insert(index);
+                return {it, false};
             }
-            catch(const std::out_of_range& p_exception)
+
+            linkSlot(index, hash);
+            evictOverflow(index);
+
+            return {Iterator(m_vector, m_hashes, m_valuesMap, index), true};
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        Iterator findIfImpl(const std::function<bool(const mappedType&)>& p_function) const
+        {
+            for (auto i = 0u; i != m_vector.size(); ++i)
             {
-                return endImpl();
+                if (m_vector[i].has_value() && p_function(*m_vector[i]))
+                    return Iterator(m_vector, m_hashes, m_valuesMap, i);
+            }
+
+            return endImpl();
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        void deleteAllImpl(const std::function<bool(const mappedType&)>& p_function)
+        {
+            for (auto i = 0u; i != m_vector.size(); ++i)
+            {
+                if (m_vector[i].has_value() && p_function(*m_vector[i]))
+                    unlinkSlot(i);
+            }
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        key_type nextIndexImpl() const
+        { return m_logicalDeletedKeys.empty() ? m_vector.size() : *m_logicalDeletedKeys.begin(); }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        std::size_t capacityImpl() const
+        { return m_vector.size() + m_reserveSize; }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        bool isContiguousImpl() const
+        {
+            bool hasValue = false;
+            for (auto it = m_vector.rbegin(); it != m_vector.rend(); ++it)
+            {
+                if (it->has_value())
+                    hasValue = true;
+                else if (hasValue)
+                    return false;
+            }
+
+            return true;
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        Iterator beginImpl() const
+        {
+            for (auto i = 0u; i < m_vector.size(); ++i)
+            {
+                if (m_vector[i].has_value())
+                    return Iterator(m_vector, m_hashes, m_valuesMap, i);
             }
+
+            return endImpl();
+        }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        Iterator endImpl() const
+        { return Iterator(m_vector, m_hashes, m_valuesMap, m_vector.end()); }
+
+        /**
+         * @note You must lock the @p m_mutex before calling this function!
+         */
+        Iterator findImpl(const mapped_type& p_value, THash p_hash) const
+        {
+            const auto it = m_valuesMap.find(MappedKey{p_hash, p_value});
+            if (it == m_valuesMap.end())
+                return endImpl();
+
+            touch(it->second);
+            return Iterator(m_vector, m_hashes, m_valuesMap, it->second);
         }
 
         TVector m_vector;
+        THashVector m_hashes;
         TMappedMap m_valuesMap;
         std::set<key_type> m_logicalDeletedKeys;
+        // The ids held by blocks, which are neither used nor deleted.
+        std::set<key_type> m_reservedKeys;
         unsigned m_reserveSize = 0;
+        version_type m_version = 0;
+        std::deque<Change> m_changeLog;
+        std::size_t m_changeLogCapacity = 0;
+        mutable std::deque<SlotStats> m_slotStats;
+        bool m_trackFrequency = false;
+        std::size_t m_maxSize = 0;
+        std::size_t m_clockHand = 0;
+        TEvictionCallback m_evictionCallback;
         mutable TMutex m_mutex;
 };
 
+/**
+ * Immutable bimap created by id_bimap::freeze().
+ *
+ * The values are packed in key order, and the key -> value lookup is a direct index when
+ * the keys are contiguous, a binary search otherwise. The value -> key lookup uses a
+ * minimal perfect hash built with hash and displace: the value's bucket selects a seed,
+ * and the seeded hash gives the only slot the value can be in. A bucket of one value
+ * stores its slot instead of a seed, so the last free slots are filled without a search.
+ * The slot stores a fingerprint, so most missing values are rejected without comparing
+ * them.
+ *
+ * There is no lock, since nothing can be modified.
+ */
+template <typename mappedType, typename keyType>
+class frozen_id_bimap
+{
+    public:
+        using mapped_type = mappedType;
+        using key_type = keyType;
+
+        frozen_id_bimap() = default;
+
+        std::size_t size() const
+        { return m_values.size(); }
+
+        bool empty() const
+        { return m_values.empty(); }
+
+        key_type operator[](const mapped_type& p_value) const
+        {
+            const auto index = findIndex(p_value);
+            if (index == m_values.size())
+                throw std::domain_error("domain error");
+
+            return keyAt(index);
+        }
+
+        const mapped_type& operator[](const key_type& p_key) const
+        {
+            if (m_keys.empty())
+            {
+                if (static_cast<std::size_t>(p_key) < m_values.size())
+                    return m_values[p_key];
+            }
+            else
+            {
+                const auto it = std::lower_bound(m_keys.cbegin(), m_keys.cend(), p_key);
+                if (it != m_keys.cend() && *it == p_key)
+                    return m_values[std::distance(m_keys.cbegin(), it)];
+            }
+            throw std::out_of_range("out of range");
+        }
+
+        bool contains(const mapped_type& p_value) const
+        { return findIndex(p_value) != m_values.size(); }
+
+        /**
+         * @return false if the values fell back to the sorted lookup, e.g. because some
+         * of them share their full hash.
+         */
+        bool has_perfect_hash() const
+        { return m_values.empty() || !m_seeds.empty(); }
+
+        /**
+         * @return A mutable map with the same keys and values.
+         */
+        id_bimap<mapped_type, key_type> thaw() const &
+        {
+            auto values = m_values;
+            return id_bimap<mapped_type, key_type>::fromSlots(allKeys(), std::move(values));
+        }
+
+        id_bimap<mapped_type, key_type> thaw() &&
+        {
+            auto result = id_bimap<mapped_type, key_type>::fromSlots(allKeys(), std::move(m_values));
+            *this = frozen_id_bimap();
+            return result;
+        }
+
+    private:
+        template <typename, typename>
+        friend class id_bimap;
+
+        static_assert(std::is_invocable_v<std::hash<mapped_type>, const mapped_type&>,
+            "Freezing requires a std::hash specialization of the value.");
+
+        struct Slot
+        {
+            std::uint32_t m_index;
+            std::uint32_t m_fingerprint;
+        };
+
+        static constexpr std::size_t s_bucketLoad = 2;
+        static constexpr std::uint32_t s_maxSeed = 1u << 24;
+        // Marks a seed that is the slot of a bucket of one value.
+        static constexpr std::uint32_t s_directSlot = 1u << 31;
+
+        frozen_id_bimap(std::vector<key_type>&& p_keys, std::vector<mapped_type>&& p_values)
+            : m_values(std::move(p_values))
+        {
+            const bool contiguous = p_keys.empty() || static_cast<std::size_t>(p_keys.back()) + 1 == p_keys.size();
+            if (!contiguous)
+                m_keys = std::move(p_keys);
+
+            if (!buildPerfectHash())
+                buildSorted();
+        }
+
+        static std::uint64_t mix(std::uint64_t p_value)
+        {
+            p_value ^= p_value >> 30;
+            p_value *= 0xbf58476d1ce4e5b9ull;
+            p_value ^= p_value >> 27;
+            p_value *= 0x94d049bb133111ebull;
+            return p_value ^ (p_value >> 31);
+        }
+
+        static std::uint64_t hashOf(const mapped_type& p_value)
+        { return mix(std::hash<mapped_type>{}(p_value)); }
+
+        static std::uint32_t fingerprintOf(std::uint64_t p_hash)
+        { return static_cast<std::uint32_t>(p_hash >> 32); }
+
+        std::size_t bucketOf(std::uint64_t p_hash) const
+        { return p_hash % m_seeds.size(); }
+
+        std::size_t slotOf(std::uint64_t p_hash, std::uint32_t p_seed) const
+        {
+            if (p_seed & s_directSlot)
+                return p_seed & ~s_directSlot;
+            return mix(p_hash + (p_seed + 1ull) * 0x9e3779b97f4a7c15ull) % m_slots.size();
+        }
+
+        /**
+         * Places the buckets from the largest one, trying seeds until every value of the
+         * bucket lands in a free slot. The buckets of one value come last and take the
+         * remaining slots in order.
+         *
+         * @return false if a bucket could not be placed, e.g. because two values share
+         * their full hash.
+         */
+        bool buildPerfectHash()
+        {
+            const auto count = m_values.size();
+            if (!count)
+                return true;
+            if (count >= s_directSlot)
+                return false;
+
+            m_seeds.assign((count + s_bucketLoad - 1) / s_bucketLoad, 0);
+            m_slots.assign(count, Slot{0, 0});
+
+            std::vector<std::uint64_t> hashes(count);
+            std::vector<std::vector<std::uint32_t>> buckets(m_seeds.size());
+            for (auto i = 0u; i < count; ++i)
+            {
+                hashes[i] = hashOf(m_values[i]);
+                buckets[bucketOf(hashes[i])].push_back(i);
+            }
+
+            std::vector<std::uint32_t> order(buckets.size());
+            for (auto i = 0u; i < order.size(); ++i)
+                order[i] = i;
+            std::stable_sort(order.begin(), order.end(), [&buckets](auto p_lhs, auto p_rhs)
+                { return buckets[p_lhs].size() > buckets[p_rhs].size(); });
+
+            std::vector<bool> taken(count, false);
+            std::vector<std::size_t> positions;
+            std::size_t nextFree = 0;
+            for (const auto bucketIndex : order)
+            {
+                const auto& bucket = buckets[bucketIndex];
+                if (bucket.empty())
+                    break;
+
+                if (bucket.size() == 1)
+                {
+                    while (taken[nextFree])
+                        ++nextFree;
+                    taken[nextFree] = true;
+                    m_seeds[bucketIndex] = s_directSlot | static_cast<std::uint32_t>(nextFree);
+                    m_slots[nextFree] = Slot{bucket.front(), fingerprintOf(hashes[bucket.front()])};
+                    continue;
+                }
+
+                // No seed separates two values with the same hash.
+                for (auto i = 1u; i < bucket.size(); ++i)
+                {
+                    for (auto j = 0u; j < i; ++j)
+                    {
+                        if (hashes[bucket[i]] == hashes[bucket[j]])
+                            return clearPerfectHash();
+                    }
+                }
+
+                bool placed = false;
+
+                for (std::uint32_t seed = 0; seed < s_maxSeed && !placed; ++seed)
+                {
+                    positions.clear();
+                    placed = true;
+                    for (const auto index : bucket)
+                    {
+                        const auto slot = slotOf(hashes[index], seed);
+                        if (taken[slot] || std::find(positions.cbegin(), positions.cend(), slot) != positions.cend())
+                        {
+                            placed = false;
+                            break;
+                        }
+                        positions.push_back(slot);
+                    }
+
+                    if (placed)
+                        m_seeds[bucketIndex] = seed;
+                }
+
+                if (!placed)
+                    return clearPerfectHash();
+
+                for (auto i = 0u; i < bucket.size(); ++i)
+                {
+                    taken[positions[i]] = true;
+                    m_slots[positions[i]] = Slot{bucket[i], fingerprintOf(hashes[bucket[i]])};
+                }
+            }
+
+            return true;
+        }
+
+        bool clearPerfectHash()
+        {
+            m_seeds.clear();
+            m_slots.clear();
+            return false;
+        }
+
+        /**
+         * Fallback when no perfect hash was found: the slots are sorted by value.
+         */
+        void buildSorted()
+        {
+            m_slots.resize(m_values.size());
+            for (auto i = 0u; i < m_slots.size(); ++i)
+                m_slots[i] = Slot{i, 0};
+            std::sort(m_slots.begin(), m_slots.end(), [this](const Slot& p_lhs, const Slot& p_rhs)
+                { return m_values[p_lhs.m_index] < m_values[p_rhs.m_index]; });
+        }
+
+        /**
+         * @return The index of the value in @p m_values, or the size if it is missing.
+         */
+        std::size_t findIndex(const mapped_type& p_value) const
+        {
+            if (m_values.empty())
+                return 0;
+
+            if (m_seeds.empty())
+            {
+                const auto it = std::lower_bound(m_slots.cbegin(), m_slots.cend(), p_value,
+                    [this](const Slot& p_slot, const mapped_type& p_other)
+                    { return m_values[p_slot.m_index] < p_other; });
+                if (it != m_slots.cend() && !(p_value < m_values[it->m_index]))
+                    return it->m_index;
+                return m_values.size();
+            }
+
+            const auto hash = hashOf(p_value);
+            const auto& slot = m_slots[slotOf(hash, m_seeds[bucketOf(hash)])];
+            if (slot.m_fingerprint == fingerprintOf(hash) && m_values[slot.m_index] == p_value)
+                return slot.m_index;
+            return m_values.size();
+        }
+
+        key_type keyAt(std::size_t p_index) const
+        { return m_keys.empty() ? static_cast<key_type>(p_index) : m_keys[p_index]; }
+
+        std::vector<key_type> allKeys() const
+        {
+            if (!m_keys.empty())
+                return m_keys;
+
+            std::vector<key_type> keys(m_values.size());
+            for (auto i = 0u; i < keys.size(); ++i)
+                keys[i] = i;
+            return keys;
+        }
+
+        std::vector<mapped_type> m_values;
+        // Empty when the keys are 0, 1, ..., size() - 1.
+        std::vector<key_type> m_keys;
+        std::vector<std::uint32_t> m_seeds;
+        std::vector<Slot> m_slots;
+};
+
 template <typename mapped_type = NoValueType>
 using kchar_id_bimap = id_bimap<mapped_type, char>;
 
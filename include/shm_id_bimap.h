@@ -0,0 +1,541 @@
+#ifndef SHMIDBIMAP_H
+#define SHMIDBIMAP_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Bimap of strings living in a POSIX shared-memory segment, so several processes can
+ * query and modify the same map without copying it.
+ *
+ * The segment holds a fixed number of slots, an arena for the bytes of the values and an
+ * open-addressing hash table of slot ids for the value -> key direction. Everything is
+ * addressed by offsets from the start of the segment, so each process may map it at a
+ * different address. The map is guarded by a process-shared reader-writer lock.
+ *
+ * Like id_bimap, the smallest deleted id is reused first. The bytes of erased values are
+ * not reclaimed, and inserting into a full map throws std::length_error.
+ *
+ * @note Every process must be built with the same key type and the same ABI.
+ */
+template <typename keyType = std::size_t>
+class shm_id_bimap
+{
+    public:
+        using mapped_type = std::string_view;
+        using key_type = keyType;
+
+        /**
+         * Creates a new named segment with shm_open().
+         */
+        static shm_id_bimap create(const std::string& p_name, std::size_t p_maxEntries, std::size_t p_arenaSize)
+        {
+            const int fd = ::shm_open(p_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0)
+                throwErrno("shm_open");
+
+            try
+            {
+                auto result = create(fd, p_maxEntries, p_arenaSize);
+                ::close(fd);
+                return result;
+            }
+            catch (...)
+            {
+                ::close(fd);
+                ::shm_unlink(p_name.c_str());
+                throw;
+            }
+        }
+
+        /**
+         * Maps an existing named segment.
+         */
+        static shm_id_bimap open(const std::string& p_name)
+        {
+            const int fd = ::shm_open(p_name.c_str(), O_RDWR, 0);
+            if (fd < 0)
+                throwErrno("shm_open");
+
+            try
+            {
+                auto result = open(fd);
+                ::close(fd);
+                return result;
+            }
+            catch (...)
+            {
+                ::close(fd);
+                throw;
+            }
+        }
+
+        /**
+         * Initializes the map in the shared-memory object of @p p_fd, e.g. from memfd_create().
+         * The descriptor is not closed.
+         */
+        static shm_id_bimap create(int p_fd, std::size_t p_maxEntries, std::size_t p_arenaSize)
+        {
+            static_assert(std::is_integral<key_type>::value, "Key must be integer!");
+
+            if (!p_maxEntries)
+                throw std::invalid_argument("empty shm_id_bimap");
+            if (!fitsKey(p_maxEntries))
+                throw std::invalid_argument("shm_id_bimap ids do not fit in the key type");
+
+            Layout layout(p_maxEntries, p_arenaSize);
+            if (::ftruncate(p_fd, layout.m_segmentSize) != 0)
+                throwErrno("ftruncate");
+
+            shm_id_bimap result(map(p_fd, layout.m_segmentSize), layout.m_segmentSize);
+
+            auto& header = result.header();
+            header.m_layout = layout;
+            header.m_slotCount = 0;
+            header.m_size = 0;
+            header.m_freeCount = 0;
+            header.m_arenaUsed = 0;
+            header.m_tombstones = 0;
+            std::fill_n(result.table(), layout.m_tableSize, s_emptyEntry);
+
+            pthread_rwlockattr_t attributes;
+            ::pthread_rwlockattr_init(&attributes);
+            ::pthread_rwlockattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+            const int error = ::pthread_rwlock_init(&header.m_lock, &attributes);
+            ::pthread_rwlockattr_destroy(&attributes);
+            if (error)
+                throw std::system_error(error, std::generic_category(), "pthread_rwlock_init");
+
+            header.m_magic = s_magic;
+            return result;
+        }
+
+        /**
+         * Maps the map created in the shared-memory object of @p p_fd. The descriptor is not
+         * closed.
+         */
+        static shm_id_bimap open(int p_fd)
+        {
+            struct stat status;
+            if (::fstat(p_fd, &status) != 0)
+                throwErrno("fstat");
+
+            const auto size = static_cast<std::size_t>(status.st_size);
+            if (size < sizeof(Header))
+                throw std::invalid_argument("not an shm_id_bimap segment");
+
+            shm_id_bimap result(map(p_fd, size), size);
+            if (result.header().m_magic != s_magic || result.header().m_layout.m_segmentSize != size)
+                throw std::invalid_argument("not an shm_id_bimap segment");
+            if (!fitsKey(result.header().m_layout.m_maxEntries))
+                throw std::invalid_argument("shm_id_bimap ids do not fit in the key type");
+
+            return result;
+        }
+
+        /**
+         * Removes the name of a segment. Processes having it mapped keep using it.
+         */
+        static void remove(const std::string& p_name)
+        { ::shm_unlink(p_name.c_str()); }
+
+        shm_id_bimap(shm_id_bimap&& p_other) noexcept
+            : m_base(std::exchange(p_other.m_base, nullptr))
+            , m_segmentSize(std::exchange(p_other.m_segmentSize, 0))
+        {}
+
+        shm_id_bimap& operator=(shm_id_bimap&& p_other) noexcept
+        {
+            if (this != &p_other)
+            {
+                unmap();
+                m_base = std::exchange(p_other.m_base, nullptr);
+                m_segmentSize = std::exchange(p_other.m_segmentSize, 0);
+            }
+            return *this;
+        }
+
+        shm_id_bimap(const shm_id_bimap&) = delete;
+        shm_id_bimap& operator=(const shm_id_bimap&) = delete;
+
+        ~shm_id_bimap()
+        { unmap(); }
+
+        std::size_t size() const
+        {
+            ReadLock lock(header().m_lock);
+            return header().m_size;
+        }
+
+        bool empty() const
+        { return size() == 0; }
+
+        /**
+         * @return The number of values the segment can hold.
+         */
+        std::size_t max_size() const
+        { return header().m_layout.m_maxEntries; }
+
+        std::pair<key_type, bool> insert(mapped_type p_value)
+        {
+            WriteLock lock(header().m_lock);
+
+            auto& header = this->header();
+            const auto hash = hashOf(p_value);
+            auto [position, found] = probe(p_value, hash);
+            if (found)
+                return {static_cast<key_type>(table()[position] - 1), false};
+
+            if (!header.m_freeCount && header.m_slotCount == header.m_layout.m_maxEntries)
+                throw std::length_error("shm_id_bimap is full");
+            if (p_value.size() > std::numeric_limits<std::uint32_t>::max() ||
+                p_value.size() > header.m_layout.m_arenaSize - header.m_arenaUsed)
+                throw std::length_error("shm_id_bimap arena is full");
+
+            // Keep at least a quarter of the table empty so that every probe terminates.
+            if ((header.m_size + header.m_tombstones + 1) * 4 > header.m_layout.m_tableSize * 3)
+            {
+                rehash();
+                position = probe(p_value, hash).first;
+            }
+
+            std::uint64_t index;
+            if (header.m_freeCount)
+            {
+                std::pop_heap(freeIds(), freeIds() + header.m_freeCount, std::greater<std::uint64_t>());
+                index = freeIds()[--header.m_freeCount];
+            }
+            else
+            {
+                index = header.m_slotCount++;
+            }
+
+            std::memcpy(arena() + header.m_arenaUsed, p_value.data(), p_value.size());
+            slots()[index] = Slot{header.m_arenaUsed, hash, static_cast<std::uint32_t>(p_value.size())};
+            header.m_arenaUsed += p_value.size();
+
+            if (table()[position] == s_tombstone)
+                --header.m_tombstones;
+            table()[position] = index + 1;
+            ++header.m_size;
+
+            return {static_cast<key_type>(index), true};
+        }
+
+        key_type operator[](mapped_type p_value) const
+        {
+            ReadLock lock(header().m_lock);
+
+            const auto [position, found] = probe(p_value, hashOf(p_value));
+            if (!found)
+                throw std::domain_error("domain error");
+
+            return static_cast<key_type>(table()[position] - 1);
+        }
+
+        /**
+         * @return A view into the segment, valid while it is mapped.
+         */
+        mapped_type operator[](const key_type& p_key) const
+        {
+            ReadLock lock(header().m_lock);
+
+            if (!isUsed(p_key))
+                throw std::out_of_range("out of range");
+
+            return valueAt(p_key);
+        }
+
+        bool contains(mapped_type p_value) const
+        {
+            ReadLock lock(header().m_lock);
+            return probe(p_value, hashOf(p_value)).second;
+        }
+
+        void erase(key_type p_key)
+        {
+            WriteLock lock(header().m_lock);
+
+            if (isUsed(p_key))
+                eraseAt(probe(valueAt(p_key), slots()[p_key].m_hash).first);
+        }
+
+        void erase(mapped_type p_value)
+        {
+            WriteLock lock(header().m_lock);
+
+            const auto [position, found] = probe(p_value, hashOf(p_value));
+            if (found)
+                eraseAt(position);
+        }
+
+        key_type next_index() const
+        {
+            ReadLock lock(header().m_lock);
+            return static_cast<key_type>(header().m_freeCount ? freeIds()[0] : header().m_slotCount);
+        }
+
+    private:
+        static constexpr std::uint64_t s_magic = 0x70616d6962646925ull;
+        static constexpr std::uint64_t s_emptyEntry = 0;
+        static constexpr std::uint64_t s_tombstone = ~std::uint64_t(0);
+        static constexpr std::uint64_t s_unusedSlot = ~std::uint64_t(0);
+
+        /**
+         * The hash is kept so that the probes compare it before the bytes, and so that
+         * erasing and rehashing do not hash the value again.
+         */
+        struct Slot
+        {
+            std::uint64_t m_offset;
+            std::uint64_t m_hash;
+            std::uint32_t m_length;
+        };
+
+        /**
+         * Offsets of the regions of the segment, computed once by the creator.
+         */
+        struct Layout
+        {
+            Layout() = default;
+
+            Layout(std::size_t p_maxEntries, std::size_t p_arenaSize)
+                : m_maxEntries(p_maxEntries)
+                , m_arenaSize(p_arenaSize)
+            {
+                m_tableSize = 1;
+                while (m_tableSize < 2 * m_maxEntries)
+                    m_tableSize *= 2;
+
+                m_slotsOffset = align(sizeof(Header));
+                m_freeIdsOffset = align(m_slotsOffset + m_maxEntries * sizeof(Slot));
+                m_tableOffset = align(m_freeIdsOffset + m_maxEntries * sizeof(std::uint64_t));
+                m_arenaOffset = align(m_tableOffset + m_tableSize * sizeof(std::uint64_t));
+                m_segmentSize = m_arenaOffset + m_arenaSize;
+            }
+
+            static std::uint64_t align(std::uint64_t p_offset)
+            { return (p_offset + 63) & ~std::uint64_t(63); }
+
+            std::uint64_t m_maxEntries;
+            std::uint64_t m_arenaSize;
+            std::uint64_t m_tableSize;
+            std::uint64_t m_slotsOffset;
+            std::uint64_t m_freeIdsOffset;
+            std::uint64_t m_tableOffset;
+            std::uint64_t m_arenaOffset;
+            std::uint64_t m_segmentSize;
+        };
+
+        struct Header
+        {
+            std::uint64_t m_magic;
+            Layout m_layout;
+            // Number of slots ever used, the deleted ones included.
+            std::uint64_t m_slotCount;
+            std::uint64_t m_size;
+            // Deleted ids, kept as a min-heap.
+            std::uint64_t m_freeCount;
+            std::uint64_t m_arenaUsed;
+            std::uint64_t m_tombstones;
+            pthread_rwlock_t m_lock;
+        };
+
+        struct ReadLock
+        {
+            explicit ReadLock(pthread_rwlock_t& p_lock)
+                : m_lock(p_lock)
+            { ::pthread_rwlock_rdlock(&m_lock); }
+
+            ~ReadLock()
+            { ::pthread_rwlock_unlock(&m_lock); }
+
+            pthread_rwlock_t& m_lock;
+        };
+
+        struct WriteLock
+        {
+            explicit WriteLock(pthread_rwlock_t& p_lock)
+                : m_lock(p_lock)
+            { ::pthread_rwlock_wrlock(&m_lock); }
+
+            ~WriteLock()
+            { ::pthread_rwlock_unlock(&m_lock); }
+
+            pthread_rwlock_t& m_lock;
+        };
+
+        shm_id_bimap(void* p_base, std::size_t p_segmentSize)
+            : m_base(static_cast<char*>(p_base))
+            , m_segmentSize(p_segmentSize)
+        {}
+
+        /**
+         * @return Whether every id of a segment of @p p_maxEntries values fits in the key.
+         */
+        static bool fitsKey(std::uint64_t p_maxEntries)
+        {
+            return p_maxEntries - 1 <=
+                static_cast<std::make_unsigned_t<key_type>>(std::numeric_limits<key_type>::max());
+        }
+
+        [[noreturn]] static void throwErrno(const char* p_what)
+        { throw std::system_error(errno, std::generic_category(), p_what); }
+
+        static void* map(int p_fd, std::size_t p_size)
+        {
+            void* base = ::mmap(nullptr, p_size, PROT_READ | PROT_WRITE, MAP_SHARED, p_fd, 0);
+            if (base == MAP_FAILED)
+                throwErrno("mmap");
+            return base;
+        }
+
+        void unmap()
+        {
+            if (m_base)
+                ::munmap(m_base, m_segmentSize);
+            m_base = nullptr;
+        }
+
+        /**
+         * FNV-1a, as the hash must be the same in every process.
+         */
+        static std::uint64_t hashOf(mapped_type p_value)
+        {
+            std::uint64_t hash = 0xcbf29ce484222325ull;
+            for (const auto byte : p_value)
+            {
+                hash ^= static_cast<unsigned char>(byte);
+                hash *= 0x100000001b3ull;
+            }
+            return hash;
+        }
+
+        Header& header() const
+        { return *reinterpret_cast<Header*>(m_base); }
+
+        Slot* slots() const
+        { return reinterpret_cast<Slot*>(m_base + header().m_layout.m_slotsOffset); }
+
+        std::uint64_t* freeIds() const
+        { return reinterpret_cast<std::uint64_t*>(m_base + header().m_layout.m_freeIdsOffset); }
+
+        std::uint64_t* table() const
+        { return reinterpret_cast<std::uint64_t*>(m_base + header().m_layout.m_tableOffset); }
+
+        char* arena() const
+        { return m_base + header().m_layout.m_arenaOffset; }
+
+        /**
+         * @note You must lock the segment before calling this function!
+         */
+        bool isUsed(key_type p_key) const
+        {
+            return static_cast<std::uint64_t>(p_key) < header().m_slotCount &&
+                slots()[p_key].m_offset != s_unusedSlot;
+        }
+
+        /**
+         * @note You must lock the segment before calling this function!
+         */
+        mapped_type valueAt(std::uint64_t p_index) const
+        {
+            const auto& slot = slots()[p_index];
+            return mapped_type(arena() + slot.m_offset, slot.m_length);
+        }
+
+        /**
+         * @note You must lock the segment before calling this function!
+         *
+         * @return The table position of the value and true, or the position where it
+         * should be inserted and false.
+         */
+        std::pair<std::uint64_t, bool> probe(mapped_type p_value, std::uint64_t p_hash) const
+        {
+            const auto mask = header().m_layout.m_tableSize - 1;
+            const auto* entries = table();
+
+            auto firstTombstone = s_tombstone;
+            for (auto position = p_hash & mask; ; position = (position + 1) & mask)
+            {
+                const auto entry = entries[position];
+                if (entry == s_emptyEntry)
+                    return {firstTombstone != s_tombstone ? firstTombstone : position, false};
+
+                if (entry == s_tombstone)
+                {
+                    if (firstTombstone == s_tombstone)
+                        firstTombstone = position;
+                    continue;
+                }
+
+                const auto& slot = slots()[entry - 1];
+                if (slot.m_hash == p_hash && valueAt(entry - 1) == p_value)
+                    return {position, true};
+            }
+        }
+
+        /**
+         * @note You must lock the segment for writing before calling this function!
+         */
+        void eraseAt(std::uint64_t p_position)
+        {
+            auto& header = this->header();
+            const auto index = table()[p_position] - 1;
+
+            table()[p_position] = s_tombstone;
+            ++header.m_tombstones;
+            slots()[index].m_offset = s_unusedSlot;
+            --header.m_size;
+
+            freeIds()[header.m_freeCount++] = index;
+            std::push_heap(freeIds(), freeIds() + header.m_freeCount, std::greater<std::uint64_t>());
+        }
+
+        /**
+         * Drops the tombstones by reinserting every used slot with its stored hash.
+         *
+         * @note You must lock the segment for writing before calling this function!
+         */
+        void rehash()
+        {
+            auto& header = this->header();
+            const auto mask = header.m_layout.m_tableSize - 1;
+            auto* entries = table();
+
+            std::fill_n(entries, header.m_layout.m_tableSize, s_emptyEntry);
+            for (std::uint64_t index = 0; index < header.m_slotCount; ++index)
+            {
+                const auto& slot = slots()[index];
+                if (slot.m_offset == s_unusedSlot)
+                    continue;
+
+                auto position = slot.m_hash & mask;
+                while (entries[position] != s_emptyEntry)
+                    position = (position + 1) & mask;
+                entries[position] = index + 1;
+            }
+            header.m_tombstones = 0;
+        }
+
+        char* m_base;
+        std::size_t m_segmentSize;
+};
+
+#endif
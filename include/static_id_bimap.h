@@ -0,0 +1,114 @@
+#ifndef STATICIDBIMAP_H
+#define STATICIDBIMAP_H
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+
+/**
+ * Fixed-capacity bimap of @p N values that can be built and queried at compile time.
+ *
+ * The keys are the positions of the values in the constructor. The values are kept in
+ * that order together with an index sorted by value, so both lookups are constexpr.
+ * A duplicated value throws std::logic_error, which is a compile error in a constant
+ * expression.
+ *
+ * @code
+ * constexpr auto Verbs = make_static_id_bimap<std::string_view>("GET", "PUT", "POST");
+ * static_assert(Verbs["PUT"] == 1);
+ * @endcode
+ */
+template <std::size_t N, typename mappedType, typename keyType = std::size_t>
+class static_id_bimap
+{
+    public:
+        using mapped_type = mappedType;
+        using key_type = keyType;
+
+        template <typename... Args>
+        constexpr static_id_bimap(const Args&... p_values)
+            : m_values{mapped_type(p_values)...}
+            , m_order{}
+        {
+            static_assert(sizeof...(Args) == N, "The number of values must be N.");
+            static_assert(!std::is_same<std::remove_cv_t<mapped_type>, std::remove_cv_t<key_type>>::value,
+                "Key and value must be separate types.");
+            static_assert(std::is_integral<key_type>::value, "Key must be integer!");
+            static_assert(N == 0 || N - 1 <= static_cast<std::size_t>(std::numeric_limits<key_type>::max()),
+                "Every position must fit in the key type.");
+
+            // Insertion sort, as std::sort is not constexpr before C++20.
+            for (std::size_t i = 0; i < N; ++i)
+            {
+                std::size_t j = i;
+                for (; j > 0 && m_values[i] < m_values[m_order[j - 1]]; --j)
+                    m_order[j] = m_order[j - 1];
+                m_order[j] = static_cast<key_type>(i);
+            }
+
+            for (std::size_t i = 1; i < N; ++i)
+            {
+                if (!(m_values[m_order[i - 1]] < m_values[m_order[i]]))
+                    throw std::logic_error("duplicate value");
+            }
+        }
+
+        constexpr std::size_t size() const
+        { return N; }
+
+        constexpr bool empty() const
+        { return N == 0; }
+
+        constexpr const mapped_type& operator[](const key_type& p_key) const
+        {
+            if (static_cast<std::size_t>(p_key) < N)
+                return m_values[p_key];
+            throw std::out_of_range("out of range");
+        }
+
+        constexpr key_type operator[](const mapped_type& p_value) const
+        {
+            const auto key = find(p_value);
+            if (!key)
+                throw std::domain_error("domain error");
+            return *key;
+        }
+
+        constexpr std::optional<key_type> find(const mapped_type& p_value) const
+        {
+            std::size_t first = 0;
+            std::size_t last = N;
+            while (first < last)
+            {
+                const auto middle = first + (last - first) / 2;
+                if (m_values[m_order[middle]] < p_value)
+                    first = middle + 1;
+                else
+                    last = middle;
+            }
+
+            if (first < N && !(p_value < m_values[m_order[first]]))
+                return m_order[first];
+            return std::nullopt;
+        }
+
+        constexpr bool contains(const mapped_type& p_value) const
+        { return find(p_value).has_value(); }
+
+        constexpr const std::array<mapped_type, N>& values() const
+        { return m_values; }
+
+    private:
+        std::array<mapped_type, N> m_values;
+        // The keys sorted by their values.
+        std::array<key_type, N> m_order;
+};
+
+template <typename mappedType, typename keyType = std::size_t, typename... Args>
+constexpr auto make_static_id_bimap(const Args&... p_values)
+{ return static_id_bimap<sizeof...(Args), mappedType, keyType>(p_values...); }
+
+#endif
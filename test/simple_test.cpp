@@ -1,13 +1,26 @@
 #include "id_bimap.h"
+#include "async_inserter.h"
+#include "shm_id_bimap.h"
+#include "static_id_bimap.h"
 
 #include <cassert>
+#include <chrono>
+#include <future>
 #include <iostream>
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <type_traits>
 #include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <gtest/gtest.h>
 
@@ -412,6 +425,647 @@ TEST(IdBimapTest, F3b_reserve)
          "reserve() should not directly construct any elements!");
 }
 
+// IGNORE! Helper type whose hash collides for every value with the same parity.
+struct ParityHashed
+{
+  int ID = 0;
+
+  bool operator==(const ParityHashed& R) const { return ID == R.ID; }
+  bool operator<(const ParityHashed& R) const { return ID < R.ID; }
+};
+
+template <>
+struct std::hash<ParityHashed>
+{
+  std::size_t operator()(const ParityHashed& V) const { return V.ID % 2; }
+};
+
+TEST(IdBimapTest, F4_fingerprint)
+{
+  // Colliding fingerprints fall back to comparing the values.
+  id_bimap<ParityHashed> PM;
+  for (int I = 0; I < 100; ++I)
+    EXPECT_TRUE(PM.insert(ParityHashed{I}).second);
+  for (int I = 0; I < 100; ++I)
+    EXPECT_TRUE(PM[ParityHashed{I}] == static_cast<std::size_t>(I));
+  EXPECT_TRUE(PM.find(ParityHashed{100}) == PM.end());
+  EXPECT_TRUE(PM.insert(ParityHashed{42}).second == false);
+
+  // Growth, copy and reserve reuse the fingerprints and keep both directions valid.
+  const std::string Prefix(200, 'u');
+  string_id_bimap SM;
+  for (int I = 0; I < 1000; ++I)
+    SM.insert(Prefix + std::to_string(I));
+
+  SM.erase(Prefix + "500");
+  SM.reserve(4096);
+
+  const string_id_bimap CSM = SM;
+  for (const string_id_bimap* M : {static_cast<const string_id_bimap*>(&SM), &CSM})
+  {
+    EXPECT_TRUE(M->size() == 999);
+    for (int I = 0; I < 1000; ++I)
+    {
+      if (I == 500)
+        EXPECT_TRUE(M->find(Prefix + "500") == M->end());
+      else
+        EXPECT_TRUE((*M)[Prefix + std::to_string(I)] == static_cast<std::size_t>(I) &&
+               (*M)[static_cast<std::size_t>(I)] == Prefix + std::to_string(I));
+    }
+  }
+
+  // A duplicate emplace does not replace the existing mapping.
+  auto ER1 = SM.emplace(Prefix + "7");
+  EXPECT_TRUE(ER1.second == false && ER1.first->first == 7);
+  EXPECT_TRUE(SM.size() == 999);
+}
+
+TEST(IdBimapTest, F5_asyncInserter)
+{
+  string_id_bimap SM;
+  SM.insert("gsd");
+
+  const int Producers = 4;
+  const int Values = 500;
+  std::vector<std::vector<std::future<std::size_t>>> Futures(Producers);
+  {
+    async_inserter<string_id_bimap> AI(SM, 64);
+
+    std::vector<std::thread> Threads;
+    for (int T = 0; T < Producers; ++T)
+      Threads.emplace_back([&AI, &Futures, T]()
+      {
+        // Every producer enqueues the same values, so batches contain duplicates.
+        for (int I = 0; I < Values; ++I)
+          Futures[T].push_back(AI.insert(std::to_string(I)));
+        Futures[T].push_back(AI.insert("gsd"));
+      });
+
+    for (auto& Thread : Threads)
+      Thread.join();
+  } // Destruction drains the queue.
+
+  EXPECT_TRUE(SM.size() == 1 + Values);
+  for (int T = 0; T < Producers; ++T)
+  {
+    for (int I = 0; I < Values; ++I)
+      EXPECT_TRUE(Futures[T][I].get() == SM[std::to_string(I)]);
+    EXPECT_TRUE(Futures[T][Values].get() == 0);
+  }
+
+  std::vector<std::string> Batch{"Herb", "gsd", "Herb"};
+  EXPECT_TRUE(SM.insert_batch(Batch.begin(), Batch.begin()).empty());
+  auto Keys = SM.insert_batch(Batch.begin(), Batch.end());
+  EXPECT_TRUE(Keys.size() == 3 && Keys[0] == Keys[2] && Keys[1] == 0);
+}
+
+TEST(IdBimapTest, F6_reserveBlock)
+{
+  string_id_bimap SM = {"gsd", "Whisperity", "Herb"};
+  SM.erase("Whisperity");
+
+  {
+    auto B1 = SM.reserve_block(3); // Reuses 1, appends 3 and 4.
+    EXPECT_TRUE(B1.remaining() == 3 && SM.next_index() == 5);
+
+    auto IR1 = B1.insert("Bjarne");
+    EXPECT_TRUE(IR1.second && IR1.first == 1);
+    auto IR2 = B1.insert("gsd"); // Existing value, no id is used.
+    EXPECT_TRUE(!IR2.second && IR2.first == 0 && B1.remaining() == 2);
+    EXPECT_TRUE(B1.insert("Xazax").first == 3);
+    EXPECT_TRUE(B1.insert("Bjarne").first == 1); // Staged in the block.
+
+    // The staged values are published on flush.
+    EXPECT_TRUE(SM.size() == 2 && SM.find("Bjarne") == SM.end());
+    EXPECT_TRUE(B1.flush().empty());
+    EXPECT_TRUE(SM[3] == "Xazax" && SM["Bjarne"] == 1 && SM.size() == 4);
+  } // Id 4 is returned.
+
+  EXPECT_TRUE(SM.next_index() == 4);
+  EXPECT_TRUE(SM.insert("Bryce").first->first == 4);
+  EXPECT_TRUE(SM.is_contiguous());
+
+  // Exhausted blocks refill themselves, and concurrent blocks never share an id.
+  const int Threads = 4;
+  const int Values = 300;
+  string_id_bimap TM;
+  std::vector<std::vector<std::size_t>> Keys(Threads);
+  std::vector<std::thread> Workers;
+  for (int T = 0; T < Threads; ++T)
+    Workers.emplace_back([&TM, &Keys, T]()
+    {
+      auto Block = TM.reserve_block(16);
+      for (int I = 0; I < Values; ++I)
+        Keys[T].push_back(Block.insert(std::to_string(T) + ":" + std::to_string(I)).first);
+    });
+  for (auto& Worker : Workers)
+    Worker.join();
+
+  EXPECT_TRUE(TM.size() == Threads * Values);
+  for (int T = 0; T < Threads; ++T)
+    for (int I = 0; I < Values; ++I)
+      EXPECT_TRUE(TM[Keys[T][I]] == std::to_string(T) + ":" + std::to_string(I));
+
+  // The unused ids of the released blocks are reused first.
+  EXPECT_TRUE(TM.next_index() < TM.capacity());
+
+  // A value published by another thread first keeps its key, and so does a value
+  // whose id a clear() has invalidated.
+  string_id_bimap DM;
+  {
+    auto B2 = DM.reserve_block(2);
+    auto B3 = DM.reserve_block(2);
+    const auto K2 = B2.insert("Herb").first;
+    const auto K3 = B3.insert("Herb").first;
+    EXPECT_TRUE(K2 != K3 && B2.flush().empty());
+    const auto Remap = B3.flush();
+    EXPECT_TRUE(Remap.size() == 1 && Remap.at(K3) == K2 && DM[K2] == "Herb" && DM.size() == 1);
+
+    const auto K4 = B3.insert("Bjarne").first;
+    DM.clear();
+    const auto Remap2 = B3.release();
+    EXPECT_TRUE(DM.size() == 1 && DM["Bjarne"] == (Remap2.count(K4) ? Remap2.at(K4) : K4));
+  }
+  // Shrinking keeps the ids of a held block and the deleted ids before them.
+  string_id_bimap RM = {"a", "b", "c", "d"};
+  {
+    auto B2 = RM.reserve_block(2); // Appends 4 and 5.
+    RM.erase("b");
+    RM.reserve(5);
+    EXPECT_TRUE(RM.next_index() == 1);
+
+    // A copy does not own the block, so the reserved ids are free in it.
+    string_id_bimap CM = RM;
+    EXPECT_TRUE(CM.next_index() == 1 && CM.size() == 3);
+    CM.insert("x");
+    EXPECT_TRUE(CM.insert("y").first->first == 4 && CM.insert("z").first->first == 5);
+  }
+  EXPECT_TRUE(RM.insert("b").first->first == 1);
+  RM.reserve(4);
+  EXPECT_TRUE(RM.is_contiguous() && RM.capacity() == 4 && RM.next_index() == 4);
+}
+
+TEST(IdBimapTest, F7_freeze)
+{
+  string_id_bimap SM;
+  for (int I = 0; I < 1000; ++I)
+    SM.insert("value" + std::to_string(I));
+
+  const auto FSM = SM.freeze();
+  EXPECT_TRUE(FSM.size() == 1000 && !FSM.empty() && FSM.has_perfect_hash());
+  for (int I = 0; I < 1000; ++I)
+    EXPECT_TRUE(FSM["value" + std::to_string(I)] == static_cast<std::size_t>(I) &&
+           FSM[static_cast<std::size_t>(I)] == "value" + std::to_string(I));
+  EXPECT_TRUE(!FSM.contains("value1000") && FSM.contains("value999"));
+
+  try
+  {
+    FSM["Xazax"];
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::domain_error&) {}
+
+  try
+  {
+    FSM[1000];
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::out_of_range&) {}
+
+  // Holes are kept, and thawing restores them as deleted ids.
+  SM.erase("value3");
+  SM.erase(1);
+  auto FSM2 = SM.freeze();
+  EXPECT_TRUE(FSM2.size() == 998 && FSM2[4] == "value4" && FSM2["value5"] == 5);
+  EXPECT_TRUE(!FSM2.contains("value3"));
+  try
+  {
+    FSM2[3];
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::out_of_range&) {}
+
+  auto TSM = std::move(FSM2).thaw();
+  EXPECT_TRUE(FSM2.empty());
+  EXPECT_TRUE(TSM.size() == 998 && TSM["value999"] == 999 && TSM[0u] == "value0");
+  EXPECT_TRUE(TSM.next_index() == 1);
+  EXPECT_TRUE(TSM.insert("gsd").first->first == 1 && TSM.insert("Herb").first->first == 3);
+  EXPECT_TRUE(TSM.is_contiguous());
+
+  // Moving out of the mutable map leaves it empty.
+  auto FSM3 = std::move(SM).freeze();
+  EXPECT_TRUE(SM.empty() && FSM3.size() == 998);
+
+  // Large maps get a perfect hash too.
+  const int Large = 200000;
+  string_id_bimap LM;
+  for (int I = 0; I < Large; ++I)
+    LM.insert("value" + std::to_string(I));
+  const auto FLM = std::move(LM).freeze();
+  EXPECT_TRUE(FLM.has_perfect_hash() && FLM.size() == Large);
+  for (int I = 0; I < Large; ++I)
+    EXPECT_TRUE(FLM["value" + std::to_string(I)] == static_cast<std::size_t>(I));
+  EXPECT_TRUE(!FLM.contains("value" + std::to_string(Large)));
+
+  // Values sharing their full hash fall back to a sorted lookup.
+  id_bimap<ParityHashed> PM;
+  for (int I = 0; I < 50; ++I)
+    PM.insert(ParityHashed{I});
+  const auto FPM = PM.freeze();
+  EXPECT_TRUE(!FPM.has_perfect_hash());
+  for (int I = 0; I < 50; ++I)
+    EXPECT_TRUE(FPM[ParityHashed{I}] == static_cast<std::size_t>(I));
+  EXPECT_TRUE(!FPM.contains(ParityHashed{50}));
+}
+
+namespace
+{
+constexpr auto Verbs = make_static_id_bimap<std::string_view>("GET", "PUT", "POST", "DELETE");
+
+static_assert(Verbs.size() == 4 && !Verbs.empty());
+static_assert(Verbs["GET"] == 0 && Verbs["DELETE"] == 3);
+static_assert(Verbs[2u] == "POST");
+static_assert(!Verbs.contains("PATCH") && !Verbs.find("HEAD").has_value());
+
+constexpr int dispatch(std::string_view Verb)
+{
+  switch (Verbs.find(Verb).value_or(Verbs.size()))
+  {
+    case Verbs["GET"]: return 1;
+    case Verbs["PUT"]: return 2;
+    default: return 0;
+  }
+}
+static_assert(dispatch("PUT") == 2 && dispatch("HEAD") == 0);
+}
+
+TEST(IdBimapTest, F8_static)
+{
+  constexpr static_id_bimap<3, int, char> Numbers(30, 10, 20);
+  static_assert(Numbers[20] == 2 && Numbers[static_cast<char>(1)] == 10);
+
+  EXPECT_TRUE(dispatch("GET") == 1);
+
+  try
+  {
+    Verbs["PATCH"];
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::domain_error&) {}
+
+  try
+  {
+    Verbs[4u];
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::out_of_range&) {}
+
+  // Duplicates are a compile error in constant expressions and throw otherwise.
+  try
+  {
+    make_static_id_bimap<std::string_view>("GET", "PUT", "GET");
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::logic_error&) {}
+}
+
+TEST(IdBimapTest, F9_merge)
+{
+  string_id_bimap SM = {"gsd", "Whisperity", "Herb"};
+  SM.erase("Whisperity");
+
+  string_id_bimap OM = {"Bjarne", "Herb", "Xazax", "Bryce"};
+  OM.erase("Xazax");
+
+  auto Remap = SM.merge(OM);
+  EXPECT_TRUE(Remap.size() == 4);
+  EXPECT_TRUE(Remap[0] == 1u);          // "Bjarne" reuses the deleted id.
+  EXPECT_TRUE(Remap[1] == 2u);          // "Herb" is already present.
+  EXPECT_TRUE(!Remap[2].has_value());   // Deleted in the other map.
+  EXPECT_TRUE(Remap[3] == 3u);          // "Bryce" is appended.
+  EXPECT_TRUE(SM.size() == 4 && SM["Bryce"] == 3 && SM[1u] == "Bjarne");
+  EXPECT_TRUE(OM.size() == 3);
+
+  // Merging itself changes nothing.
+  auto SelfRemap = SM.merge(SM);
+  EXPECT_TRUE(SelfRemap.size() == 4 && SelfRemap[3] == 3u && SM.size() == 4);
+
+  // N-way merge.
+  string_id_bimap AM = {"gsd", "Alexandrescu"};
+  string_id_bimap BM = {"Alexandrescu", "Hyrum"};
+  auto Remaps = SM.merge({&AM, &BM});
+  EXPECT_TRUE(Remaps.size() == 2);
+  EXPECT_TRUE(Remaps[0][0] == 0u && Remaps[0][1] == 4u);
+  EXPECT_TRUE(Remaps[1][0] == 4u && Remaps[1][1] == 5u);
+  EXPECT_TRUE(SM.size() == 6 && SM.is_contiguous());
+
+  // Large maps are looked up in parallel.
+  id_bimap<int> LM;
+  id_bimap<int> RM;
+  for (int I = 0; I < 100000; ++I)
+  {
+    LM.insert(2 * I);
+    RM.insert(3 * I);
+  }
+
+  auto LargeRemap = LM.merge(RM);
+  EXPECT_TRUE(LM.size() == 100000 + 100000 - 33334);
+  for (int I = 0; I < 100000; ++I)
+    EXPECT_TRUE(LM[static_cast<std::size_t>(*LargeRemap[I])] == 3 * I);
+}
+
+TEST(IdBimapTest, F10_changeFeed)
+{
+  string_id_bimap Master = {"gsd", "Whisperity"};
+  Master.set_change_log_capacity(4);
+  EXPECT_TRUE(Master.version() == 2);
+
+  string_id_bimap Replica = Master;
+  EXPECT_TRUE(Replica.version() == 2);
+
+  Master.insert("Herb");
+  Master.insert("gsd"); // Not a modification.
+  Master.erase("gsd");
+  Master.insert("Bjarne"); // Reuses id 0.
+  EXPECT_TRUE(Master.version() == 5);
+
+  auto Delta = Master.changes_since(Replica.version());
+  EXPECT_TRUE(Delta && Delta->m_from == 2 && Delta->m_to == 5 && Delta->m_changes.size() == 3);
+  EXPECT_TRUE(Master.changes_since(5)->m_changes.empty());
+
+  Replica.apply(*Delta);
+  EXPECT_TRUE(Replica.version() == 5 && Replica.size() == 3);
+  EXPECT_TRUE(Replica[0u] == "Bjarne" && Replica["Herb"] == 2 && Replica.find("gsd") == Replica.end());
+
+  // Applying the same delta twice is rejected.
+  try
+  {
+    Replica.apply(*Delta);
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::invalid_argument&) {}
+
+  // Erases leave holes, and the replica keeps the same ids.
+  Master.erase(1);
+  Master.insert("Xazax");
+  Master.insert("Bryce");
+  Replica.apply(*Master.changes_since(Replica.version()));
+  EXPECT_TRUE(Replica[1u] == "Xazax" && Replica[3u] == "Bryce" && Replica.size() == 4);
+  EXPECT_TRUE(Replica.next_index() == 4);
+
+  // Older changes have been dropped, the replica has to be copied again.
+  Master.clear();
+  Master.insert("Hyrum");
+  EXPECT_TRUE(!Master.changes_since(5).has_value());
+  EXPECT_TRUE(!Master.changes_since(Master.version() + 1).has_value());
+  Replica.apply(*Master.changes_since(Replica.version()));
+  EXPECT_TRUE(Replica.size() == 1 && Replica[0u] == "Hyrum" && Replica.version() == Master.version());
+}
+
+TEST(IdBimapTest, F11_sharedMemory)
+{
+  const int Fd = memfd_create("id_bimap_test", 0);
+  ASSERT_TRUE(Fd >= 0);
+
+  auto SM = shm_id_bimap<>::create(Fd, 64, 4096);
+  EXPECT_TRUE(SM.empty() && SM.max_size() == 64);
+
+  EXPECT_TRUE(SM.insert("gsd").first == 0);
+  EXPECT_TRUE(SM.insert("Whisperity").first == 1);
+  EXPECT_TRUE(SM.insert("Herb").first == 2);
+  EXPECT_TRUE(SM.insert("gsd").second == false);
+  SM.erase("Whisperity");
+  EXPECT_TRUE(SM.size() == 2 && SM.next_index() == 1);
+
+  try
+  {
+    SM["Whisperity"];
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::domain_error&) {}
+
+  try
+  {
+    SM[1];
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::out_of_range&) {}
+
+  // Another process sees and modifies the same map.
+  const pid_t Child = fork();
+  ASSERT_TRUE(Child >= 0);
+  if (Child == 0)
+  {
+    auto CSM = shm_id_bimap<>::open(Fd);
+    const bool Ok = CSM["Herb"] == 2 && CSM[0] == "gsd" && !CSM.contains("Whisperity") &&
+                    CSM.insert("Bjarne").first == 1;
+    _exit(Ok ? 0 : 1);
+  }
+
+  int Status = 0;
+  waitpid(Child, &Status, 0);
+  EXPECT_TRUE(WIFEXITED(Status) && WEXITSTATUS(Status) == 0);
+  EXPECT_TRUE(SM[1] == "Bjarne" && SM["Bjarne"] == 1 && SM.size() == 3);
+
+  // Churn leaves tombstones, which are dropped when the table fills up.
+  for (int I = 0; I < 1000; ++I)
+  {
+    const auto Value = std::to_string(I);
+    const auto Key = SM.insert(Value).first;
+    EXPECT_TRUE(SM[Value] == Key);
+    SM.erase(Key);
+  }
+  EXPECT_TRUE(SM.size() == 3 && SM["Herb"] == 2);
+
+  try
+  {
+    for (int I = 0; I < 100; ++I)
+      SM.insert("full" + std::to_string(I));
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::length_error&) {}
+
+  // The ids must fit in the key type, both when creating and when opening.
+  const int NarrowFd = memfd_create("id_bimap_narrow", 0);
+  ASSERT_TRUE(NarrowFd >= 0);
+  try
+  {
+    shm_id_bimap<unsigned char>::create(NarrowFd, 1000, 4096);
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::invalid_argument&) {}
+  EXPECT_TRUE(shm_id_bimap<unsigned char>::create(NarrowFd, 256, 4096).max_size() == 256);
+  shm_id_bimap<>::create(NarrowFd, 1000, 4096);
+  try
+  {
+    shm_id_bimap<unsigned char>::open(NarrowFd);
+    EXPECT_TRUE(false && "Unreachable.");
+  } catch (const std::invalid_argument&) {}
+  close(NarrowFd);
+
+  close(Fd);
+
+  // Named segments.
+  const std::string Name = "/id_bimap_test_" + std::to_string(getpid());
+  {
+    auto NSM = shm_id_bimap<unsigned>::create(Name, 16, 256);
+    NSM.insert("Xazax");
+    auto OSM = shm_id_bimap<unsigned>::open(Name);
+    EXPECT_TRUE(OSM["Xazax"] == 0u);
+  }
+  shm_id_bimap<unsigned>::remove(Name);
+}
+
+TEST(IdBimapTest, F12_eviction)
+{
+  string_id_bimap SM = {"gsd", "Whisperity", "Herb", "Bjarne"};
+
+  std::vector<std::pair<std::size_t, std::string>> Evicted;
+  SM.set_eviction_callback([&Evicted](std::size_t Key, const std::string& Value)
+  {
+    Evicted.emplace_back(Key, Value);
+  });
+  SM.set_max_size(4);
+  EXPECT_TRUE(SM.max_size() == 4 && SM.size() == 4);
+
+  // Recently looked up values get a second chance.
+  SM["gsd"];
+  SM[1u];
+  auto IR1 = SM.insert("Xazax");
+  EXPECT_TRUE(IR1.second && SM.size() == 4);
+  EXPECT_TRUE(Evicted.size() == 1 && Evicted[0].first == 2 && Evicted[0].second == "Herb");
+  EXPECT_TRUE(IR1.first->first == 4 && SM.find("Herb") == SM.end());
+
+  // The evicted id is reused by the next insertion.
+  EXPECT_TRUE(SM.insert("Bryce").first->first == 2);
+  EXPECT_TRUE(Evicted.size() == 2 && Evicted[1].second == "Bjarne");
+  EXPECT_TRUE(SM.size() == 4);
+
+  // Lowering the bound evicts immediately.
+  SM.set_max_size(2);
+  EXPECT_TRUE(SM.size() == 2 && Evicted.size() == 4);
+
+  // Memory stays flat under unbounded input.
+  SM.set_max_size(16);
+  for (int I = 0; I < 1000; ++I)
+    SM.insert(std::to_string(I));
+  EXPECT_TRUE(SM.size() == 16 && SM.capacity() <= 17);
+
+  SM.set_max_size(0);
+  SM.insert("Alexandrescu");
+  EXPECT_TRUE(SM.size() == 17);
+  // A replica does not evict on its own, it follows the evictions of its master.
+  string_id_bimap MM = {"a", "b", "c"};
+  MM.set_max_size(3);
+  MM.set_change_log_capacity(16);
+  string_id_bimap RM = MM;
+  RM["a"];
+  MM["b"];
+  MM["c"];
+  MM.insert("d"); // Evicts "a" in the master only.
+  RM.apply(*MM.changes_since(RM.version()));
+  EXPECT_TRUE(RM.version() == MM.version() && RM.size() == 3 && MM.size() == 3);
+  for (const auto& Value : {"b", "c", "d"})
+    EXPECT_TRUE(RM[std::string(Value)] == MM[std::string(Value)]);
+  EXPECT_TRUE(RM.find("a") == RM.end());
+  // A batch evicts after it is inserted, so it never hands out a key twice.
+  string_id_bimap BM;
+  BM.set_max_size(2);
+  const std::vector<std::string> Batch = {"x", "y", "z", "w"};
+  const auto Keys = BM.insert_batch(Batch.cbegin(), Batch.cend());
+  EXPECT_TRUE(BM.size() == 2 && std::set<std::size_t>(Keys.cbegin(), Keys.cend()).size() == 4);
+  for (auto I = 0u; I < Batch.size(); ++I)
+    EXPECT_TRUE(BM.find(Batch[I]) == BM.end() || BM[Keys[I]] == Batch[I]);
+
+  // So does a merge.
+  string_id_bimap GM = {"a"};
+  GM.set_max_size(2);
+  const string_id_bimap OM = {"p", "q", "r", "s"};
+  const auto Remap = GM.merge(OM);
+  std::set<std::size_t> Merged;
+  for (const auto& Key : Remap)
+    Merged.insert(*Key);
+  EXPECT_TRUE(GM.size() == 2 && Merged.size() == 4);
+  for (auto I = 0u; I < Remap.size(); ++I)
+    EXPECT_TRUE(GM.find(OM[I]) == GM.end() || GM[*Remap[I]] == OM[I]);
+}
+
+TEST(IdBimapTest, F13_sessions)
+{
+  string_id_bimap SM = {"gsd", "Whisperity", "Herb"};
+
+  {
+    const auto Session = SM.read_session();
+    EXPECT_TRUE(Session.size() == 3 && !Session.empty());
+    EXPECT_TRUE(Session["Herb"] == 2 && Session[1u] == "Whisperity");
+    EXPECT_TRUE(Session.find("Xazax") == Session.end());
+    EXPECT_TRUE(Session.next_index() == 3 && Session.capacity() == 3 && Session.is_contiguous());
+
+    EXPECT_TRUE(Session.version() == 3 && Session.max_size() == 0 && Session.access_count(2) == 0);
+    EXPECT_TRUE(!Session.changes_since(2) && Session.changes_since(3)->m_changes.empty());
+
+    // Other readers are not blocked. The lock is not recursive, so they must run in
+    // other threads.
+    EXPECT_TRUE(std::async(std::launch::async, [&SM]() { return SM.size(); }).get() == 3);
+
+    std::ostringstream OSS;
+    for (const auto& E : Session)
+      OSS << E.first << ":" << E.second << ", ";
+    EXPECT_TRUE(OSS.str() == "0:gsd, 1:Whisperity, 2:Herb, ");
+  }
+
+  std::thread Writer;
+  {
+    auto Session = SM.write_session();
+    auto IR1 = Session.insert("Bjarne");
+    EXPECT_TRUE(IR1.second && IR1.first->first == 3);
+    EXPECT_TRUE(Session.emplace("gsd").second == false);
+    Session.erase("Whisperity");
+    Session.erase(0u);
+    Session.delete_all([](const std::string& E) { return E == "Herb"; });
+    EXPECT_TRUE(Session.size() == 1 && Session.next_index() == 0);
+    const std::vector<std::string> Batch = {"Bryce", "Bjarne"};
+    EXPECT_TRUE(Session.insert_batch(Batch.cbegin(), Batch.cend()) == std::vector<std::size_t>({0, 3}));
+    Session.erase(0u);
+    Session.reserve(8);
+    EXPECT_TRUE(Session.capacity() == 8);
+    EXPECT_TRUE(Session.find_if([](const std::string& E) { return E[0] == 'B'; })->first == 3);
+
+    // Writers of other threads wait for the session.
+    Writer = std::thread([&SM]() { SM.insert("Xazax"); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(Session.size() == 1);
+    Session.clear();
+  }
+  Writer.join();
+
+  EXPECT_TRUE(SM.size() == 1 && SM["Xazax"] == 0);
+}
+
+TEST(IdBimapTest, F14_reorderByFrequency)
+{
+  string_id_bimap SM = {"gsd", "Whisperity", "Herb", "Bjarne", "Xazax"};
+  SM.set_change_log_capacity(16);
+  SM.erase("Whisperity");
+
+  SM.track_access_frequency(true);
+  for (int I = 0; I < 3; ++I)
+    SM["Xazax"];
+  SM[2u];
+  SM.find("Herb");
+  SM["Bjarne"];
+  EXPECT_TRUE(SM.access_count(4) == 3 && SM.access_count(2) == 2 && SM.access_count(0) == 0);
+
+  const auto Version = SM.version();
+  auto Remap = SM.reorder_by_frequency();
+  EXPECT_TRUE(Remap.size() == 5);
+  EXPECT_TRUE(Remap[4] == 0u && Remap[2] == 1u && Remap[3] == 2u && Remap[0] == 3u);
+  EXPECT_TRUE(!Remap[1].has_value());
+
+  EXPECT_TRUE(SM.size() == 4 && SM.is_contiguous() && SM.capacity() == 4);
+  EXPECT_TRUE(SM["Xazax"] == 0 && SM[1u] == "Herb" && SM["Bjarne"] == 2 && SM[3u] == "gsd");
+  EXPECT_TRUE(SM.access_count(0) == 4); // The counts move with the values.
+  EXPECT_TRUE(!SM.changes_since(Version).has_value());
+
+  SM.insert("Bryce");
+  EXPECT_TRUE(SM["Bryce"] == 4 && SM.access_count(4) == 1);
+
+  // Without tracking the order is kept.
+  string_id_bimap UM = {"gsd", "Herb"};
+  UM["Herb"];
+  auto IdentityRemap = UM.reorder_by_frequency();
+  EXPECT_TRUE(IdentityRemap[0] == 0u && IdentityRemap[1] == 1u);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();